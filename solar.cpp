@@ -15,8 +15,41 @@
 #include <vector>
 #include <cmath>
 #include <map> 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include <iomanip> 
 #include <sstream> // For formatting strings for ImGui
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Headless rendering (build with -DSOLAR_WITH_EGL and link -lEGL)
+#ifdef SOLAR_WITH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 // ImGui Includes
 #include "imgui.h"
@@ -32,6 +65,9 @@ using namespace std;
 // --- Settings ---
 unsigned int SCR_WIDTH = 1920;
 unsigned int SCR_HEIGHT = 1080;
+const float CAMERA_NEAR = 0.1f, CAMERA_FAR = 1000.0f; // Scene projection; depth linearisation uses the same planes
+unsigned int randomSeed = 0;   // --seed N; otherwise the inner belt is seeded from the clock
+bool hasRandomSeed = false;
 
 // --- Camera and Interaction ---
 float cameraDistance = 50.0f;
@@ -64,10 +100,592 @@ struct Moon {
     float orbitRadius;   // Distance from parent
     float orbitSpeed;    // Angular speed multiplier
     float size;          // Relative size
-    GLuint texture;      // Moon texture
+    float eccentricity = 0.0f;
 };
 vector<Moon> moons;
 
+// --- CPU Trace Zones ---
+// RAII zones recorded into per-thread buffers and written as Chrome trace JSON (about:tracing,
+// Perfetto). Each buffer is written only by its own thread, which publishes events with a release
+// store of its count, so recording takes no locks. When no capture is running a zone costs one
+// relaxed atomic load. start() bumps an epoch; each thread resets its own buffer when it sees it.
+struct TraceEvent {
+    const char* name; // String literal
+    int64_t startNs, endNs;
+};
+
+class CpuTrace {
+public:
+    static const int EVENTS_PER_THREAD = 1 << 17; // Full buffers drop events rather than block
+
+    static int64_t nowNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool recording() const { return active.load(memory_order_relaxed); }
+
+    void start() {
+        captureStartNs = nowNs();
+        epoch.fetch_add(1, memory_order_acq_rel);
+        active.store(true, memory_order_release);
+    }
+
+    void nameThread(const char* name) {
+        ThreadBuffer& b = threadBuffer();
+        lock_guard<mutex> lock(registryMutex);
+        b.threadName = name;
+    }
+
+    void record(const char* name, int64_t startNs, int64_t endNs) {
+        ThreadBuffer& b = threadBuffer();
+        unsigned int current = epoch.load(memory_order_acquire);
+        if (b.epoch.load(memory_order_relaxed) != current) {
+            if (b.events.empty()) b.events.resize(EVENTS_PER_THREAD); // First capture on this thread
+            b.count.store(0, memory_order_relaxed);
+            b.epoch.store(current, memory_order_release);
+        }
+        int i = b.count.load(memory_order_relaxed);
+        if (i >= EVENTS_PER_THREAD) return;
+        b.events[i] = {name, startNs, endNs};
+        b.count.store(i + 1, memory_order_release);
+    }
+
+    // Stop recording and write everything captured since start()
+    bool stopAndWrite(const string& path) {
+        active.store(false, memory_order_release);
+        unsigned int current = epoch.load(memory_order_acquire);
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cerr << "ERROR::TRACE::CANNOT_OPEN " << path << endl;
+            return false;
+        }
+        lock_guard<mutex> lock(registryMutex);
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool firstEvent = true;
+        size_t eventCount = 0;
+        for (const unique_ptr<ThreadBuffer>& b : buffers) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    firstEvent ? "" : ",\n", b->tid, b->threadName.c_str());
+            firstEvent = false;
+            if (b->epoch.load(memory_order_acquire) != current) continue;
+            int count = b->count.load(memory_order_acquire);
+            for (int i = 0; i < count; ++i) {
+                const TraceEvent& e = b->events[i];
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        e.name, b->tid, (e.startNs - captureStartNs) / 1000.0, (e.endNs - e.startNs) / 1000.0);
+            }
+            eventCount += count;
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        cout << "Wrote " << path << " (" << eventCount << " CPU zones)" << endl;
+        return true;
+    }
+
+private:
+    struct ThreadBuffer {
+        int tid = 0;
+        string threadName;
+        vector<TraceEvent> events;
+        atomic<int> count{0};
+        atomic<unsigned int> epoch{0};
+    };
+
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* buffer = registerThread();
+        return *buffer;
+    }
+
+    ThreadBuffer* registerThread() {
+        lock_guard<mutex> lock(registryMutex);
+        buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        ThreadBuffer* b = buffers.back().get();
+        b->tid = (int)buffers.size();
+        b->threadName = "Thread " + to_string(b->tid);
+        return b;
+    }
+
+    mutex registryMutex; // Thread registration, names and export only
+    vector<unique_ptr<ThreadBuffer>> buffers;
+    atomic<unsigned int> epoch{0};
+    atomic<bool> active{false};
+    int64_t captureStartNs = 0;
+};
+CpuTrace cpuTrace;
+string traceCapturePath;    // --trace FILE: capture the whole run
+int traceFramesRemaining = 0; // On-demand capture from the Performance panel
+
+struct CpuZone {
+    const char* name;
+    int64_t startNs;
+    explicit CpuZone(const char* zoneName) : name(zoneName), startNs(cpuTrace.recording() ? CpuTrace::nowNs() : 0) {}
+    ~CpuZone() {
+        if (startNs) cpuTrace.record(name, startNs, CpuTrace::nowNs());
+    }
+};
+
+// Back-to-back zones for code laid out as consecutive sections: next() closes the open zone
+class CpuZoneChain {
+public:
+    void next(const char* zoneName) {
+        end();
+        name = zoneName;
+        startNs = cpuTrace.recording() ? CpuTrace::nowNs() : 0;
+    }
+    void end() {
+        if (startNs) cpuTrace.record(name, startNs, CpuTrace::nowNs());
+        startNs = 0;
+    }
+    ~CpuZoneChain() { end(); }
+
+private:
+    const char* name = nullptr;
+    int64_t startNs = 0;
+};
+
+// --- Ephemeris: Keplerian Orbits ---
+// Elements of an orbit around the body's parent. Angles are in degrees and time is the scene's
+// animation angle (one unit = one degree of Earth's mean motion), so meanMotion is degrees per unit.
+struct OrbitalElements {
+    double semiMajor;
+    double eccentricity;
+    double inclination;
+    double ascendingNode;
+    double argPeriapsis;
+    double meanAnomalyAtEpoch;
+    double meanMotion;
+};
+
+// Perifocal -> ecliptic basis (P towards periapsis, Q 90 degrees ahead), then ecliptic
+// (x, y, z-north) -> scene (x, z-north, y) so prograde motion runs from +X towards +Z
+void orbitBasis(const OrbitalElements& el, glm::dvec3& P, glm::dvec3& Q) {
+    const double i = glm::radians(el.inclination), node = glm::radians(el.ascendingNode);
+    const double w = glm::radians(el.argPeriapsis);
+    P = glm::dvec3(cos(node) * cos(w) - sin(node) * sin(w) * cos(i), sin(w) * sin(i),
+                   sin(node) * cos(w) + cos(node) * sin(w) * cos(i));
+    Q = glm::dvec3(-cos(node) * sin(w) - sin(node) * cos(w) * cos(i), cos(w) * sin(i),
+                   -sin(node) * sin(w) + cos(node) * cos(w) * cos(i));
+}
+
+// Body i writes slot i of the output array (same layout as planetPositions). Elements are stored as
+// structure-of-arrays with the orbit orientation pre-rotated into two basis vectors. A single time is
+// solved body by body in double precision (each body needs its parent's position); the batch overload
+// instead runs the SIMD belt solver across times (see Ephemeris Batch). Parents must have a lower
+// index than children.
+class Ephemeris {
+public:
+    void setBody(int index, int parentIndex, const OrbitalElements& el) {
+        if (index >= bodyCount()) resize(index + 1);
+        glm::dvec3 P, Q;
+        orbitBasis(el, P, Q);
+        parent[index] = parentIndex;
+        a[index] = el.semiMajor;
+        e[index] = el.eccentricity;
+        b[index] = el.semiMajor * sqrt(1.0 - el.eccentricity * el.eccentricity);
+        n[index] = glm::radians(el.meanMotion);
+        M0[index] = glm::radians(el.meanAnomalyAtEpoch);
+        px[index] = P.x; py[index] = P.y; pz[index] = P.z;
+        qx[index] = Q.x; qy[index] = Q.y; qz[index] = Q.z;
+    }
+
+    // Replaces every body from 'first' onwards with the given moons (their parents are planet slots)
+    void setMoons(int first, const vector<Moon>& moonList) {
+        resize(first);
+        for (int i = 0; i < (int)moonList.size(); ++i) {
+            const Moon& m = moonList[i];
+            setBody(first + i, m.parentPlanet, {m.orbitRadius, m.eccentricity, 0.0, 0.0, 0.0, 0.0, m.orbitSpeed});
+        }
+    }
+
+    int bodyCount() const { return (int)parent.size(); }
+    float apoapsis(int body) const { return static_cast<float>(a[body] * (1.0 + e[body])); }
+
+    // Solves M = E - e sin E for the eccentric anomaly E
+    static double solveKepler(double M, double ecc) {
+        M = remainder(M, 2.0 * M_PI);
+        // Third-order series start; E = pi is the safe start for near-parabolic orbits
+        double E = ecc < 0.8 ? M + ecc * sin(M) * (1.0 + ecc * cos(M)) : M_PI * (M < 0.0 ? -1.0 : 1.0);
+        for (int iter = 0; iter < 8; ++iter) {
+            double dE = (E - ecc * sin(E) - M) / (1.0 - ecc * cos(E));
+            E -= dE;
+            if (fabs(dE) < 1e-12) break;
+        }
+        return E;
+    }
+
+    // Position relative to the parent at eccentric anomaly E (used to draw the orbit itself)
+    glm::vec3 orbitPoint(int body, double E) const {
+        double x = a[body] * (cos(E) - e[body]);
+        double y = b[body] * sin(E);
+        return glm::vec3(static_cast<float>(x * px[body] + y * qx[body]),
+                         static_cast<float>(x * py[body] + y * qy[body]),
+                         static_cast<float>(x * pz[body] + y * qz[body]));
+    }
+
+    // Writes bodyCount() positions for time t; bodies without a parent sit at the origin
+    void positionsAt(double t, glm::vec3* out) const {
+        for (int i = 0; i < bodyCount(); ++i) {
+            if (parent[i] < 0) { out[i] = glm::vec3(0.0f); continue; }
+            glm::vec3 rel = orbitPoint(i, solveKepler(M0[i] + n[i] * t, e[i]));
+            out[i] = out[parent[i]] + rel;
+        }
+    }
+
+    // Batch form for analysis: out holds timeCount * bodyCount() positions, one row per time
+    void positionsAt(const double* times, int timeCount, glm::vec3* out) const;
+
+private:
+    void resize(int count) {
+        parent.resize(count, -1);
+        for (vector<double>* v : {&a, &e, &b, &n, &M0, &px, &py, &pz, &qx, &qy, &qz}) v->resize(count, 0.0);
+    }
+
+    vector<int> parent;
+    vector<double> a, e, b, n, M0;
+    vector<double> px, py, pz, qx, qy, qz;
+};
+Ephemeris ephemeris;
+const int FIRST_MOON_BODY = 9;
+
+// J2000 eccentricity, inclination, node, longitude of perihelion and mean longitude for the planets,
+// on the scene's compressed distances and speeds. Slot 0 (Sun) is left parentless at the origin.
+void initializeEphemeris() {
+    struct PlanetRow { double a, e, i, node, lonPeri, meanLon, speed; };
+    const PlanetRow rows[8] = {
+        {12.0,  0.20563593, 7.00497902,  48.33076593,  77.45779628, 252.25032350, 4.15},  // Mercury
+        {16.0,  0.00677672, 3.39467605,  76.67984255, 131.60246718, 181.97909950, 1.62},  // Venus
+        {22.0,  0.01671123, 0.0,          0.0,        102.93768193, 100.46457166, 1.0},   // Earth
+        {30.0,  0.09339410, 1.84969142,  49.55953891, -23.94362959,  -4.55343205, 0.53},  // Mars
+        {50.0,  0.04838624, 1.30439695, 100.47390909,  14.72847983,  34.39644051, 0.08},  // Jupiter
+        {70.0,  0.05386179, 2.48599187, 113.66242448,  92.59887831,  49.95424423, 0.03},  // Saturn
+        {85.0,  0.04725744, 0.77263783,  74.01692503, 170.95427630, 313.23810451, 0.01},  // Uranus
+        {100.0, 0.00859048, 1.77004347, 131.78422574,  44.96476227, -55.12002969, 0.006}  // Neptune
+    };
+    ephemeris.setBody(0, -1, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0});
+    for (int p = 0; p < 8; ++p) {
+        const PlanetRow& r = rows[p];
+        ephemeris.setBody(p + 1, 0, {r.a, r.e, r.i, r.node, r.lonPeri - r.node, r.meanLon - r.lonPeri, r.speed});
+    }
+}
+
+// --- Small Bodies: Structure-of-Arrays Store ---
+// Float elements for large populations, padded to SMALL_BODY_PADDING so the SIMD loop needs no tail.
+// Padding slots have a = 0 and propagate to the origin; only the first 'count' bodies are real.
+const int SMALL_BODY_PADDING = 8;
+struct SmallBodyStore {
+    int count = 0;
+    vector<float> a, e, b, n, M0, lonPeri;   // n and M0 in radians; lonPeri = node + argPeriapsis
+    vector<float> px, py, pz, qx, qy, qz;    // Orbit basis (see orbitBasis)
+    vector<float> size;
+    vector<float> x, y, z;                   // Positions from the last propagate
+
+    vector<vector<float>*> arrays() {
+        return {&a, &e, &b, &n, &M0, &lonPeri, &px, &py, &pz, &qx, &qy, &qz, &size, &x, &y, &z};
+    }
+
+    void add(const OrbitalElements& el, float bodySize) {
+        int i = count++;
+        int padded = (count + SMALL_BODY_PADDING - 1) / SMALL_BODY_PADDING * SMALL_BODY_PADDING;
+        for (vector<float>* v : arrays()) v->resize(padded, 0.0f);
+        glm::dvec3 P, Q;
+        orbitBasis(el, P, Q);
+        a[i] = (float)el.semiMajor;
+        e[i] = (float)el.eccentricity;
+        b[i] = (float)(el.semiMajor * sqrt(1.0 - el.eccentricity * el.eccentricity));
+        n[i] = (float)glm::radians(el.meanMotion);
+        M0[i] = (float)glm::radians(el.meanAnomalyAtEpoch);
+        lonPeri[i] = (float)glm::radians(el.ascendingNode + el.argPeriapsis);
+        px[i] = (float)P.x; py[i] = (float)P.y; pz[i] = (float)P.z;
+        qx[i] = (float)Q.x; qy[i] = (float)Q.y; qz[i] = (float)Q.z;
+        size[i] = bodySize;
+    }
+
+    // Reorder by mean longitude at time t so index ranges stay spatially coherent (belt sectors)
+    void sortByLongitude(double t) {
+        vector<double> key(count);
+        vector<int> order(count);
+        for (int i = 0; i < count; ++i) {
+            key[i] = fmod(lonPeri[i] + M0[i] + n[i] * t, 2.0 * M_PI);
+            if (key[i] < 0.0) key[i] += 2.0 * M_PI;
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [&](int l, int r) { return key[l] < key[r]; });
+        vector<float> scratch(count);
+        for (vector<float>* v : arrays()) {
+            for (int i = 0; i < count; ++i) scratch[i] = (*v)[order[i]];
+            copy(scratch.begin(), scratch.end(), v->begin());
+        }
+    }
+};
+
+// --- Small Bodies: SIMD Kepler Solver ---
+// Lane types for the batch kernel. Each exposes float lanes F, int lanes I and the few operations
+// propagateSmallBodies needs, so the kernel is written once and instantiated per instruction set.
+struct LanesScalar {
+    typedef float F;
+    typedef int32_t I;
+    static const int width = 1;
+    static const char* name() { return "scalar"; }
+    static F set1(float v) { return v; }
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F v) { *p = v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static I roundToInt(F v) { return (I)lrintf(v); }
+    static F toFloat(I v) { return (F)v; }
+    static I addInt(I v, int k) { return v + k; }
+    // Negate lanes whose int has bit 1 set / pick 'odd' where bit 0 is set
+    static F negateIfBit1(F v, I q) {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        bits ^= (uint32_t)(q & 2) << 30;
+        memcpy(&v, &bits, sizeof(bits));
+        return v;
+    }
+    static F selectIfBit0(I q, F odd, F even) { return (q & 1) ? odd : even; }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct LanesSSE2 {
+    typedef __m128 F;
+    typedef __m128i I;
+    static const int width = 4;
+    static const char* name() { return "SSE2"; }
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static I roundToInt(F v) { return _mm_cvtps_epi32(v); }
+    static F toFloat(I v) { return _mm_cvtepi32_ps(v); }
+    static I addInt(I v, int k) { return _mm_add_epi32(v, _mm_set1_epi32(k)); }
+    static F negateIfBit1(F v, I q) {
+        return _mm_xor_ps(v, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30)));
+    }
+    static F selectIfBit0(I q, F odd, F even) {
+        F mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        return _mm_or_ps(_mm_and_ps(mask, odd), _mm_andnot_ps(mask, even));
+    }
+};
+#endif
+
+#if defined(__AVX2__)
+struct LanesAVX2 {
+    typedef __m256 F;
+    typedef __m256i I;
+    static const int width = 8;
+    static const char* name() { return "AVX2"; }
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static I roundToInt(F v) { return _mm256_cvtps_epi32(v); }
+    static F toFloat(I v) { return _mm256_cvtepi32_ps(v); }
+    static I addInt(I v, int k) { return _mm256_add_epi32(v, _mm256_set1_epi32(k)); }
+    static F negateIfBit1(F v, I q) {
+        return _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30)));
+    }
+    static F selectIfBit0(I q, F odd, F even) {
+        __m256i one = _mm256_set1_epi32(1);
+        return _mm256_blendv_ps(even, odd, _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one)));
+    }
+};
+typedef LanesAVX2 LanesBest;
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef LanesSSE2 LanesBest;
+#else
+typedef LanesScalar LanesBest;
+#endif
+
+// sin and cos together: reduce to [-pi/4, pi/4] by quadrant, then Taylor polynomials (~1e-7 error)
+template<class L>
+inline void sinCosLanes(typename L::F x, typename L::F& s, typename L::F& c) {
+    typedef typename L::F F;
+    typename L::I quadrant = L::roundToInt(L::mul(x, L::set1(0.63661977f)));
+    F q = L::toFloat(quadrant);
+    F r = L::sub(L::sub(x, L::mul(q, L::set1(1.5707963705f))), L::mul(q, L::set1(-4.3711390e-8f)));
+    F r2 = L::mul(r, r);
+    F sr = L::add(L::set1(-1.0f / 5040.0f), L::mul(r2, L::set1(1.0f / 362880.0f)));
+    sr = L::add(L::set1(1.0f / 120.0f), L::mul(r2, sr));
+    sr = L::add(L::set1(-1.0f / 6.0f), L::mul(r2, sr));
+    sr = L::add(r, L::mul(L::mul(r, r2), sr));
+    F cr = L::add(L::set1(-1.0f / 720.0f), L::mul(r2, L::set1(1.0f / 40320.0f)));
+    cr = L::add(L::set1(1.0f / 24.0f), L::mul(r2, cr));
+    cr = L::add(L::set1(-0.5f), L::mul(r2, cr));
+    cr = L::add(L::set1(1.0f), L::mul(r2, cr));
+    s = L::negateIfBit1(L::selectIfBit0(quadrant, cr, sr), quadrant);
+    c = L::negateIfBit1(L::selectIfBit0(quadrant, sr, cr), L::addInt(quadrant, 1));
+}
+
+// Fixed Newton count: from the third-order start, 3 steps reach float precision for e < 0.5
+const int KEPLER_SIMD_ITERATIONS = 3;
+const double KEPLER_SIMD_MAX_ECCENTRICITY = 0.5;
+
+// Solves M = E - e sin E (M already reduced to [-pi, pi]) on every lane with the same step count, so
+// no lane branches out early; returns sin E and cos E
+template<class L>
+inline void solveKeplerLanes(typename L::F M, typename L::F e, typename L::F& sinE, typename L::F& cosE) {
+    typedef typename L::F F;
+    const F one = L::set1(1.0f);
+    sinCosLanes<L>(M, sinE, cosE);
+    F E = L::add(M, L::mul(L::mul(e, sinE), L::add(one, L::mul(e, cosE))));
+    for (int iter = 0; iter < KEPLER_SIMD_ITERATIONS; ++iter) {
+        sinCosLanes<L>(E, sinE, cosE);
+        F f = L::sub(L::sub(E, L::mul(e, sinE)), M);
+        E = L::sub(E, L::div(f, L::sub(one, L::mul(e, cosE))));
+    }
+    sinCosLanes<L>(E, sinE, cosE);
+}
+
+template<class L>
+void propagateSmallBodies(SmallBodyStore& sb, double t) {
+    typedef typename L::F F;
+    const int padded = (int)sb.a.size();
+    const F time = L::set1((float)t);
+    const F twoPi = L::set1(6.28318531f), invTwoPi = L::set1(0.15915494f);
+    for (int i = 0; i + L::width <= padded; i += L::width) {
+        F e = L::load(&sb.e[i]);
+        F M = L::add(L::load(&sb.M0[i]), L::mul(L::load(&sb.n[i]), time));
+        M = L::sub(M, L::mul(L::toFloat(L::roundToInt(L::mul(M, invTwoPi))), twoPi));
+        F sinE, cosE;
+        solveKeplerLanes<L>(M, e, sinE, cosE);
+        F xp = L::mul(L::load(&sb.a[i]), L::sub(cosE, e));
+        F yp = L::mul(L::load(&sb.b[i]), sinE);
+        L::store(&sb.x[i], L::add(L::mul(xp, L::load(&sb.px[i])), L::mul(yp, L::load(&sb.qx[i]))));
+        L::store(&sb.y[i], L::add(L::mul(xp, L::load(&sb.py[i])), L::mul(yp, L::load(&sb.qy[i]))));
+        L::store(&sb.z[i], L::add(L::mul(xp, L::load(&sb.pz[i])), L::mul(yp, L::load(&sb.qz[i]))));
+    }
+}
+
+// --- Ephemeris Batch ---
+// Vectorised across times rather than bodies: a body's elements are broadcast and each lane solves a
+// different time. Mean anomalies are reduced in double first (times can be large), the solve and the
+// projection run in float lanes, and a second pass per row adds the parent offsets in index order.
+// Bodies too eccentric for the fixed step count fall back to the double-precision solver.
+void Ephemeris::positionsAt(const double* times, int timeCount, glm::vec3* out) const {
+    typedef LanesBest L;
+    typedef L::F F;
+    const int bodies = bodyCount();
+    const int padded = (timeCount + L::width - 1) / L::width * L::width;
+    vector<float> M(padded, 0.0f), x(padded), y(padded), z(padded);
+    for (int i = 0; i < bodies; ++i) {
+        if (parent[i] < 0) {
+            for (int k = 0; k < timeCount; ++k) out[(size_t)k * bodies + i] = glm::vec3(0.0f);
+            continue;
+        }
+        if (e[i] >= KEPLER_SIMD_MAX_ECCENTRICITY) {
+            for (int k = 0; k < timeCount; ++k)
+                out[(size_t)k * bodies + i] = orbitPoint(i, solveKepler(M0[i] + n[i] * times[k], e[i]));
+            continue;
+        }
+        for (int k = 0; k < timeCount; ++k) M[k] = (float)remainder(M0[i] + n[i] * times[k], 2.0 * M_PI);
+        const F ecc = L::set1((float)e[i]), semiMajor = L::set1((float)a[i]), semiMinor = L::set1((float)b[i]);
+        const F Px = L::set1((float)px[i]), Py = L::set1((float)py[i]), Pz = L::set1((float)pz[i]);
+        const F Qx = L::set1((float)qx[i]), Qy = L::set1((float)qy[i]), Qz = L::set1((float)qz[i]);
+        for (int k = 0; k < padded; k += L::width) {
+            F sinE, cosE;
+            solveKeplerLanes<L>(L::load(&M[k]), ecc, sinE, cosE);
+            F xp = L::mul(semiMajor, L::sub(cosE, ecc));
+            F yp = L::mul(semiMinor, sinE);
+            L::store(&x[k], L::add(L::mul(xp, Px), L::mul(yp, Qx)));
+            L::store(&y[k], L::add(L::mul(xp, Py), L::mul(yp, Qy)));
+            L::store(&z[k], L::add(L::mul(xp, Pz), L::mul(yp, Qz)));
+        }
+        for (int k = 0; k < timeCount; ++k) out[(size_t)k * bodies + i] = glm::vec3(x[k], y[k], z[k]);
+    }
+    for (int k = 0; k < timeCount; ++k) {
+        glm::vec3* row = out + (size_t)k * bodies;
+        for (int i = 0; i < bodies; ++i)
+            if (parent[i] >= 0) row[i] += row[parent[i]];
+    }
+}
+
+// Inner belt population: a in 40-45 units, low e and i, speeds scaled around the old 0.05 deg/unit
+void generateAsteroidBelt(SmallBodyStore& sb, int count) {
+    auto frand = [](float lo, float hi) { return lo + (hi - lo) * (float)rand() / (float)RAND_MAX; };
+    for (int i = 0; i < count; ++i) {
+        OrbitalElements el;
+        el.semiMajor = frand(40.0f, 45.0f);
+        el.eccentricity = frand(0.0f, 0.08f);
+        el.inclination = frand(0.0f, 1.2f);
+        el.ascendingNode = frand(0.0f, 360.0f);
+        el.argPeriapsis = frand(0.0f, 360.0f);
+        el.meanAnomalyAtEpoch = frand(0.0f, 360.0f);
+        el.meanMotion = 0.05 * pow(42.5 / el.semiMajor, 1.5);
+        sb.add(el, frand(0.02f, 0.07f));
+    }
+}
+
+// --- Benchmark: --bench-kepler N ---
+template<class L>
+double benchmarkPropagation(SmallBodyStore& sb) {
+    int steps = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        propagateSmallBodies<L>(sb, 100.0 + steps * 0.37);
+        ++steps;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < 0.5);
+    double rate = (double)sb.count * steps / elapsed;
+    cout << "  " << setw(7) << L::name() << " (" << L::width << " lanes): " << fixed << setprecision(2)
+         << rate / 1e6 << " M bodies/s, " << setprecision(3) << elapsed * 1000.0 / steps << " ms per step" << endl;
+    return rate;
+}
+
+int runKeplerBenchmark(int count) {
+    if (count <= 0) {
+        cerr << "ERROR::BENCH::INVALID_BODY_COUNT " << count << endl;
+        return 1;
+    }
+    SmallBodyStore sb;
+    srand(12345);
+    generateAsteroidBelt(sb, count);
+    cout << "Kepler propagation, " << count << " bodies" << endl;
+    benchmarkPropagation<LanesScalar>(sb);
+    double rate = benchmarkPropagation<LanesBest>(sb);
+
+    // Accuracy against the double-precision solver
+    const double t = 1234.5;
+    propagateSmallBodies<LanesBest>(sb, t);
+    double maxError = 0.0;
+    for (int i = 0; i < sb.count; ++i) {
+        double E = Ephemeris::solveKepler(sb.M0[i] + (double)sb.n[i] * t, sb.e[i]);
+        double xp = sb.a[i] * (cos(E) - sb.e[i]), yp = sb.b[i] * sin(E);
+        double dx = xp * sb.px[i] + yp * sb.qx[i] - sb.x[i];
+        double dy = xp * sb.py[i] + yp * sb.qy[i] - sb.y[i];
+        double dz = xp * sb.pz[i] + yp * sb.qz[i] - sb.z[i];
+        maxError = max(maxError, sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    cout << "  max deviation from double-precision solver: " << scientific << setprecision(2) << maxError << " units" << endl;
+    cout << "  propagation alone fits ~" << fixed << setprecision(0) << rate / 60.0 << " bodies in a 60 fps frame" << endl;
+
+    // Planet ephemeris batch (vectorised across epochs) against the per-epoch double-precision path
+    initializeEphemeris();
+    const int epochs = min(count, 100000), bodies = ephemeris.bodyCount();
+    vector<double> times(epochs);
+    for (int k = 0; k < epochs; ++k) times[k] = k * 0.37;
+    vector<glm::vec3> batch((size_t)epochs * bodies), single(bodies);
+    auto start = chrono::steady_clock::now();
+    ephemeris.positionsAt(times.data(), epochs, batch.data());
+    double batchMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    maxError = 0.0;
+    for (int k = 0; k < epochs; ++k) {
+        ephemeris.positionsAt(times[k], single.data());
+        for (int i = 0; i < bodies; ++i) maxError = max(maxError, (double)glm::length(batch[(size_t)k * bodies + i] - single[i]));
+    }
+    cout << "Ephemeris batch, " << epochs << " epochs x " << bodies << " bodies: " << fixed << setprecision(2) << batchMs
+         << " ms, max deviation " << scientific << setprecision(2) << maxError << " units" << endl;
+    return 0;
+}
+
 // --- Asteroid Belt ---
 struct Asteroid {
     float orbitRadius;
@@ -75,9 +693,35 @@ struct Asteroid {
     float size;
     float yOffset;
 };
-vector<Asteroid> asteroidBelt;
 const int ASTEROID_COUNT = 2000;
+int asteroidCount = ASTEROID_COUNT;   // --asteroids N
 glm::mat4* asteroidMatrices;
+unsigned int asteroidInstanceVBO;   // Per-instance model matrices for the inner belt
+bool useInstancedAsteroids = true;  // false = one draw call per rock (CPU fallback for comparison)
+
+// --- Kuiper Belt (generated once, animated on the GPU) ---
+vector<Asteroid> kuiperBelt;
+const int KUIPER_COUNT = ASTEROID_COUNT * 25;
+unsigned int kuiperVAO, kuiperInstanceVBO;
+
+// --- Belt Sectors (for frustum culling) ---
+// Rocks are sorted by angle so each sector is a contiguous instance range. Kuiper bounds are stored in
+// the belt's rotating frame (it turns rigidly); the inner belt's are refitted from its positions.
+struct BeltSectors {
+    vector<int> first;
+    vector<int> count;
+    vector<glm::vec4> localBounds; // xyz = centre, w = radius
+};
+const int BELT_SECTOR_COUNT = 64;
+BeltSectors kuiperSectors; // The inner belt's sectors travel with simulation snapshots
+
+// --- Frustum Culling ---
+bool useFrustumCulling = true;
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culled = 0;
+};
+CullStats cullStats;
 
 // --- Geographic Locations on Earth ---
 struct GeographicLocation {
@@ -143,10 +787,229 @@ void initializePlanetData() {
     planetDatabase[9] = {"Moon", "0.27x Earth", "27.3 Earth days (Tidal lock)", "27.3 Earth days (orbits Earth)", "Exosphere", "Stabilizes Earth's axial tilt", "0 (orbits Earth)"};
 }
 
+// Binding point of the std140 FrameUniforms block shared by every program
+const GLuint FRAME_UBO_BINDING = 0;
+
+// --- GL Call Statistics ---
+// The render loop issues its draws, binds and uniform uploads through glStats, which makes the GL
+// call and counts it against the current pass (the GPU profiler's pass names). Binds are compared with
+// a shadow of the bound state and counted as redundant when they change nothing; they are still
+// issued, so the numbers show what batching or state sorting would save. Code that binds outside the
+// wrappers in the middle of a frame calls invalidate(), after which the next bind of each kind is
+// taken as a change.
+struct GLCallCounters {
+    unsigned int drawCalls = 0;
+    unsigned long long triangles = 0;
+    unsigned int dispatches = 0;
+    unsigned int indirectCommands = 0; // Draws inside glMultiDrawElementsIndirect calls (each call is one drawCall)
+    unsigned int programBinds = 0, redundantProgramBinds = 0;
+    unsigned int textureBinds = 0, redundantTextureBinds = 0;
+    unsigned int framebufferBinds = 0, redundantFramebufferBinds = 0;
+    unsigned int vertexArrayBinds = 0, redundantVertexArrayBinds = 0;
+    unsigned int uniformUploads = 0;
+
+    GLCallCounters& operator+=(const GLCallCounters& o) {
+        drawCalls += o.drawCalls;
+        triangles += o.triangles;
+        dispatches += o.dispatches;
+        indirectCommands += o.indirectCommands;
+        programBinds += o.programBinds;
+        redundantProgramBinds += o.redundantProgramBinds;
+        textureBinds += o.textureBinds;
+        redundantTextureBinds += o.redundantTextureBinds;
+        framebufferBinds += o.framebufferBinds;
+        redundantFramebufferBinds += o.redundantFramebufferBinds;
+        vertexArrayBinds += o.vertexArrayBinds;
+        redundantVertexArrayBinds += o.redundantVertexArrayBinds;
+        uniformUploads += o.uniformUploads;
+        return *this;
+    }
+    unsigned int redundantBinds() const {
+        return redundantProgramBinds + redundantTextureBinds + redundantFramebufferBinds + redundantVertexArrayBinds;
+    }
+};
+
+class GLCallStats {
+public:
+    static const int MAX_TEXTURE_UNITS = 32;
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    struct PassCounters {
+        string name;
+        GLCallCounters frame; // Current (or, between frames, last) frame
+        GLCallCounters total; // All frames so far, including the current one
+    };
+
+    GLCallStats() { passes.push_back({ "(outside passes)", GLCallCounters(), GLCallCounters() }); invalidate(); }
+
+    void beginFrame() {
+        for (PassCounters& p : passes) p.frame = GLCallCounters();
+        current = 0;
+        ++frames;
+        invalidate(); // ImGui and the last frame's readbacks bound behind our back
+    }
+    void beginPass(const char* name) {
+        for (size_t i = 0; i < passes.size(); ++i)
+            if (passes[i].name == name) { current = (int)i; return; }
+        current = (int)passes.size();
+        passes.push_back({ name, GLCallCounters(), GLCallCounters() });
+    }
+    void endPass() { current = 0; }
+    void invalidate() {
+        program = vertexArray = drawFramebuffer = readFramebuffer = UNKNOWN;
+        activeUnit = -1;
+        for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) textures[i] = { 0, UNKNOWN };
+    }
+
+    // --- Wrapped calls ---
+    void useProgram(GLuint id) {
+        count(&GLCallCounters::programBinds, &GLCallCounters::redundantProgramBinds, program == id);
+        program = id;
+        glUseProgram(id);
+    }
+    void bindVertexArray(GLuint id) {
+        count(&GLCallCounters::vertexArrayBinds, &GLCallCounters::redundantVertexArrayBinds, vertexArray == id);
+        vertexArray = id;
+        glBindVertexArray(id);
+    }
+    void bindFramebuffer(GLenum target, GLuint id) {
+        bool redundant = target == GL_READ_FRAMEBUFFER ? readFramebuffer == id
+                       : target == GL_DRAW_FRAMEBUFFER ? drawFramebuffer == id
+                       : drawFramebuffer == id && readFramebuffer == id;
+        count(&GLCallCounters::framebufferBinds, &GLCallCounters::redundantFramebufferBinds, redundant);
+        if (target != GL_READ_FRAMEBUFFER) drawFramebuffer = id;
+        if (target != GL_DRAW_FRAMEBUFFER) readFramebuffer = id;
+        glBindFramebuffer(target, id);
+    }
+    void activeTexture(GLenum unit) {
+        activeUnit = (int)(unit - GL_TEXTURE0);
+        glActiveTexture(unit);
+    }
+    void bindTexture(GLenum target, GLuint id) {
+        bool known = activeUnit >= 0 && activeUnit < MAX_TEXTURE_UNITS;
+        bool redundant = known && textures[activeUnit].target == target && textures[activeUnit].id == id;
+        count(&GLCallCounters::textureBinds, &GLCallCounters::redundantTextureBinds, redundant);
+        if (known) textures[activeUnit] = { target, id };
+        glBindTexture(target, id);
+    }
+    void uniformUpload() { ++passes[current].frame.uniformUploads; ++passes[current].total.uniformUploads; }
+
+    void drawArrays(GLenum mode, GLint first, GLsizei count) {
+        glDrawArrays(mode, first, count);
+        addDraw(mode, count, 1);
+    }
+    void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+        glDrawElements(mode, count, type, indices);
+        addDraw(mode, count, 1);
+    }
+    void drawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                           GLsizei instances, GLuint baseInstance) {
+        glDrawElementsInstancedBaseInstance(mode, count, type, indices, instances, baseInstance);
+        addDraw(mode, count, instances);
+    }
+    // 'triangles' is summed by the caller, which built the commands
+    void multiDrawElementsIndirect(GLenum mode, GLenum type, GLintptr offset, GLsizei drawCount, unsigned long long triangles) {
+        glMultiDrawElementsIndirect(mode, type, (const void*)offset, drawCount, 0);
+        GLCallCounters* counters[2] = { &passes[current].frame, &passes[current].total };
+        for (GLCallCounters* c : counters) {
+            ++c->drawCalls;
+            c->triangles += triangles;
+            c->indirectCommands += drawCount;
+        }
+    }
+    void dispatchCompute(GLuint x, GLuint y, GLuint z) {
+        glDispatchCompute(x, y, z);
+        ++passes[current].frame.dispatches;
+        ++passes[current].total.dispatches;
+    }
+
+    // --- Results ---
+    const vector<PassCounters>& passCounters() const { return passes; }
+    GLCallCounters frameTotal() const {
+        GLCallCounters sum;
+        for (const PassCounters& p : passes) sum += p.frame;
+        return sum;
+    }
+    int frameCount() const { return frames; }
+
+    // Per pass: the current frame's counts and the per-frame mean over the run
+    bool writeJSON(const string& path) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cerr << "ERROR::GLSTATS::CANNOT_OPEN " << path << endl;
+            return false;
+        }
+        fprintf(file, "{\n  \"frames\": %d,\n  \"passes\": [\n", frames);
+        for (size_t i = 0; i < passes.size(); ++i) {
+            fprintf(file, "    { \"name\": \"%s\",\n", passes[i].name.c_str());
+            writeCounters(file, "last_frame", passes[i].frame, 1.0, ",");
+            writeCounters(file, "mean_per_frame", passes[i].total, 1.0 / max(1, frames), "");
+            fprintf(file, "    }%s\n", i + 1 < passes.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
+
+private:
+    struct TextureBinding {
+        GLenum target;
+        GLuint id;
+    };
+
+    void count(unsigned int GLCallCounters::*binds, unsigned int GLCallCounters::*redundantBinds, bool redundant) {
+        GLCallCounters* counters[2] = { &passes[current].frame, &passes[current].total };
+        for (GLCallCounters* c : counters) {
+            ++(c->*binds);
+            if (redundant) ++(c->*redundantBinds);
+        }
+    }
+    void addDraw(GLenum mode, GLsizei count, GLsizei instances) {
+        unsigned long long triangles = mode == GL_TRIANGLES ? (unsigned long long)(count / 3) * instances : 0;
+        GLCallCounters* counters[2] = { &passes[current].frame, &passes[current].total };
+        for (GLCallCounters* c : counters) {
+            ++c->drawCalls;
+            c->triangles += triangles;
+        }
+    }
+    static void writeCounters(FILE* file, const char* key, const GLCallCounters& c, double scale, const char* separator) {
+        fprintf(file, "      \"%s\": { \"draw_calls\": %.1f, \"indirect_commands\": %.1f, \"triangles\": %.0f, \"dispatches\": %.1f, "
+                      "\"program_binds\": %.1f, \"redundant_program_binds\": %.1f, "
+                      "\"texture_binds\": %.1f, \"redundant_texture_binds\": %.1f, "
+                      "\"framebuffer_binds\": %.1f, \"redundant_framebuffer_binds\": %.1f, "
+                      "\"vertex_array_binds\": %.1f, \"redundant_vertex_array_binds\": %.1f, "
+                      "\"uniform_uploads\": %.1f }%s\n",
+                key, c.drawCalls * scale, c.indirectCommands * scale, c.triangles * scale, c.dispatches * scale,
+                c.programBinds * scale, c.redundantProgramBinds * scale,
+                c.textureBinds * scale, c.redundantTextureBinds * scale,
+                c.framebufferBinds * scale, c.redundantFramebufferBinds * scale,
+                c.vertexArrayBinds * scale, c.redundantVertexArrayBinds * scale,
+                c.uniformUploads * scale, separator);
+    }
+
+    vector<PassCounters> passes; // [0] collects calls made outside any profiler pass
+    int current = 0;
+    int frames = 0;
+    GLuint program, vertexArray, drawFramebuffer, readFramebuffer;
+    int activeUnit;
+    TextureBinding textures[MAX_TEXTURE_UNITS];
+};
+GLCallStats glStats;
+string glStatsPath; // --gl-stats FILE.json, written on exit
+bool showGLStats = false;
+
 // --- Utility: Shader Class ---
+// Typed handle to a pre-resolved uniform location. Hot paths hold these instead of names.
+template <typename T>
+struct UniformHandle {
+    GLint location = -1;
+};
+
 class Shader {
 public:
     unsigned int ID;
+    static unsigned int s_uniformLookups; // Name->location lookups since the last reset (0 in a clean hot loop)
     Shader(const char* vertexSource, const char* fragmentSource) {
         unsigned int vertex, fragment;
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -167,16 +1030,82 @@ public:
         
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        GLuint frameBlock = glGetUniformBlockIndex(ID, "FrameUniforms");
+        if (frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(ID, frameBlock, FRAME_UBO_BINDING);
+
+        cacheUniforms();
+    }
+    // Compute-only program
+    explicit Shader(const char* computeSource) {
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &computeSource, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(compute);
+
+        cacheUniforms();
+    }
+    void use() { glStats.useProgram(ID); }
+
+    // Returns the cached location for a uniform name; warns once if the program has no such active uniform
+    GLint uniform(const string &name) const {
+        ++s_uniformLookups;
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end()) return it->second;
+        if (warnedUniforms.insert(name).second)
+            cerr << "WARNING::SHADER:: uniform '" << name << "' is not active in program " << ID << endl;
+        return -1;
     }
-    void use() { glUseProgram(ID); }
-    void setBool(const string &name, bool value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); }
-    void setInt(const string &name, int value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), value); }
-    void setFloat(const string &name, float value) const { glUniform1f(glGetUniformLocation(ID, name.c_str()), value); }
-    void setVec2(const string &name, const glm::vec2 &value) const { glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
-    void setVec3(const string &name, const glm::vec3 &value) const { glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
-    void setMat4(const string &name, const glm::mat4 &mat) const { glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]); }
+    template <typename T>
+    UniformHandle<T> handle(const string &name) const { return UniformHandle<T>{ uniform(name) }; }
+
+    void setBool(const string &name, bool value) const { glUniform1i(uniform(name), (int)value); }
+    void setInt(const string &name, int value) const { glUniform1i(uniform(name), value); }
+    void setFloat(const string &name, float value) const { glUniform1f(uniform(name), value); }
+    void setVec2(const string &name, const glm::vec2 &value) const { glUniform2fv(uniform(name), 1, &value[0]); }
+    void setVec3(const string &name, const glm::vec3 &value) const { glUniform3fv(uniform(name), 1, &value[0]); }
+    void setMat4(const string &name, const glm::mat4 &mat) const { glUniformMatrix4fv(uniform(name), 1, GL_FALSE, &mat[0][0]); }
+
+    // Hot-path setters: no string hashing, the location was resolved up front; counted by glStats
+    void set(UniformHandle<bool> h, bool value) const { glStats.uniformUpload(); glUniform1i(h.location, (int)value); }
+    void set(UniformHandle<int> h, int value) const { glStats.uniformUpload(); glUniform1i(h.location, value); }
+    void set(UniformHandle<float> h, float value) const { glStats.uniformUpload(); glUniform1f(h.location, value); }
+    void set(UniformHandle<glm::vec2> h, const glm::vec2 &value) const { glStats.uniformUpload(); glUniform2fv(h.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec3> h, const glm::vec3 &value) const { glStats.uniformUpload(); glUniform3fv(h.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec4> h, const glm::vec4 &value) const { glStats.uniformUpload(); glUniform4fv(h.location, 1, &value[0]); }
+    void set(UniformHandle<glm::mat4> h, const glm::mat4 &mat) const { glStats.uniformUpload(); glUniformMatrix4fv(h.location, 1, GL_FALSE, &mat[0][0]); }
 
 private:
+    unordered_map<string, GLint> uniformLocations;
+    mutable unordered_set<string> warnedUniforms;
+
+    // Resolve every active uniform once at link time
+    void cacheUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, nameBuffer.data());
+            string name(nameBuffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0) continue; // Uniform block members have no location
+            uniformLocations[name] = location;
+            // Arrays are reported as "name[0]"; also allow lookup by the bare name
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                uniformLocations[name.substr(0, name.size() - 3)] = location;
+        }
+    }
+
     void checkCompileErrors(unsigned int shader, string type) {
         int success;
         char infoLog[1024];
@@ -196,6 +1125,37 @@ private:
     }
 };
 
+unsigned int Shader::s_uniformLookups = 0;
+
+// --- Utility: Per-Frame Uniform Buffer ---
+// Camera and lighting state shared by all programs, uploaded once per view (main scene, minimap)
+struct FrameUniforms {   // Mirrors the GLSL std140 block
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+    glm::vec4 lightPos;
+};
+unsigned int frameUBO;
+
+void createFrameUniformBuffer() {
+    glGenBuffers(1, &frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void updateFrameUniforms(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos, const glm::vec3& lightPos) {
+    FrameUniforms data;
+    data.projection = projection;
+    data.view = view;
+    data.viewPos = glm::vec4(viewPos, 1.0f);
+    data.lightPos = glm::vec4(lightPos, 1.0f);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 // --- Utility: Sphere Geometry Class ---
 class Sphere {
 public:
@@ -263,98 +1223,764 @@ public:
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     }
     void draw() {
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+        glStats.bindVertexArray(VAO);
+        glStats.drawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    }
+    void drawInstanced(int instanceCount, int baseInstance = 0) {
+        glStats.bindVertexArray(VAO);
+        glStats.drawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount, baseInstance);
     }
 };
 
-// --- Utility: Ring Geometry ---
-unsigned int ringVAO, ringVBO, ringIndexCount;
-void createRing(float innerRadius, float outerRadius, int segments) {
-    vector<float> vertices;
-    vector<unsigned int> indices;
-    for (int i = 0; i <= segments; ++i) {
-        float angle = (float)i / segments * 2.0f * M_PI;
-        float s = (float)i / segments;
-        vertices.push_back(cos(angle) * innerRadius);
-        vertices.push_back(0.0f);
-        vertices.push_back(sin(angle) * innerRadius);
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);
-        vertices.push_back(0.0f); vertices.push_back(s);
-        vertices.push_back(cos(angle) * outerRadius);
-        vertices.push_back(0.0f);
-        vertices.push_back(sin(angle) * outerRadius);
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);
-        vertices.push_back(1.0f); vertices.push_back(s);
+// --- Utility: Sphere LOD Set ---
+// Several tessellations of the unit sphere, finest first. select() returns the coarsest level whose
+// silhouette error (the chord sag r * (1 - cos(pi / sectors))) stays under maxErrorPixels on screen.
+class SphereLODSet {
+public:
+    vector<Sphere> levels;
+    vector<int> sectorCounts;
+    float maxErrorPixels = 0.5f;
+    SphereLODSet(const vector<int>& counts) : sectorCounts(counts) {
+        levels.reserve(counts.size());
+        for (int n : counts) levels.emplace_back(n, n);
     }
-    for (int i = 0; i < segments; ++i) {
-        int i0 = i * 2; int i1 = i0 + 1; int i2 = i0 + 2; int i3 = i0 + 3;
-        indices.push_back(i0); indices.push_back(i1); indices.push_back(i2);
-        indices.push_back(i1); indices.push_back(i3); indices.push_back(i2);
+    int selectLevel(float screenRadiusPixels) const {
+        for (int i = (int)levels.size() - 1; i > 0; --i) {
+            float sag = 1.0f - cosf((float)M_PI / sectorCounts[i]);
+            if (screenRadiusPixels * sag <= maxErrorPixels) return i;
+        }
+        return 0;
     }
-    ringIndexCount = static_cast<unsigned int>(indices.size());
-    glGenVertexArrays(1, &ringVAO);
-    glGenBuffers(1, &ringVBO);
-    unsigned int ringEBO;
-    glGenBuffers(1, &ringEBO);
-    glBindVertexArray(ringVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, ringVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ringEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ringIndexCount * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    Sphere& select(float screenRadiusPixels) { return levels[selectLevel(screenRadiusPixels)]; }
+};
+
+// Approximate on-screen radius (pixels) of a sphere under a perspective camera.
+// pixelScale = viewportHeight / (2 * tan(fovY / 2)).
+float projectedRadiusPixels(const glm::vec3& center, float radius, const glm::vec3& cameraPos, float pixelScale) {
+    float distance = glm::length(center - cameraPos);
+    if (distance <= radius) return 1e6f; // Camera inside the sphere: use the finest level
+    return radius * pixelScale / distance;
+}
+
+// --- Utility: Instanced Asteroid Buffer ---
+// Adds a per-instance mat4 (attribute locations 3-6) to the sphere's VAO so a whole
+// belt can be drawn with a single glDrawElementsInstanced call.
+void setupAsteroidInstancing(const Sphere& mesh, unsigned int& instanceVBO, int count) {
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBindVertexArray(mesh.VAO);
+    for (int i = 0; i < 4; ++i) {
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(3 + i, 1);
+    }
+    glBindVertexArray(0);
+}
+
+// --- Utility: GPU-Animated Belt ---
+// Builds a VAO that shares the mesh's vertex/index buffers and adds a static per-instance
+// vec4 (orbitRadius, angle, size, yOffset) at location 3. The orbit is evaluated in the vertex shader.
+void setupBeltVAO(const Sphere& mesh, const vector<Asteroid>& rocks, unsigned int& vao, unsigned int& instanceVBO) {
+    vector<glm::vec4> orbitData;
+    orbitData.reserve(rocks.size());
+    for (const Asteroid& a : rocks) {
+        orbitData.push_back(glm::vec4(a.orbitRadius, a.angle, a.size, a.yOffset));
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &instanceVBO);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, orbitData.size() * sizeof(glm::vec4), orbitData.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glVertexAttribDivisor(3, 1);
     glBindVertexArray(0);
 }
 
-// --- Orbit Globals ---
-unsigned int orbitVAO[9], orbitVBO[9], orbitEBO[9], orbitIndexCount[9];
+// Sort a belt by angle and split it into sectors with local bounding spheres
+BeltSectors buildBeltSectors(vector<Asteroid>& rocks, int sectorCount) {
+    sort(rocks.begin(), rocks.end(), [](const Asteroid& a, const Asteroid& b) { return a.angle < b.angle; });
+    BeltSectors sectors;
+    int rock = 0;
+    for (int s = 0; s < sectorCount; ++s) {
+        float sectorEnd = 360.0f * (s + 1) / sectorCount;
+        int first = rock;
+        glm::vec3 minPos(1e9f), maxPos(-1e9f);
+        float maxSize = 0.0f;
+        while (rock < (int)rocks.size() && (rocks[rock].angle < sectorEnd || s == sectorCount - 1)) {
+            const Asteroid& a = rocks[rock];
+            // Position of rotate(Y, angle) * (orbitRadius, yOffset, 0)
+            float angle = glm::radians(a.angle);
+            glm::vec3 p(a.orbitRadius * cos(angle), a.yOffset, -a.orbitRadius * sin(angle));
+            minPos = glm::min(minPos, p);
+            maxPos = glm::max(maxPos, p);
+            maxSize = max(maxSize, a.size);
+            ++rock;
+        }
+        if (rock == first) continue;
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+        float radius = 0.0f;
+        for (int i = first; i < rock; ++i) {
+            float angle = glm::radians(rocks[i].angle);
+            glm::vec3 p(rocks[i].orbitRadius * cos(angle), rocks[i].yOffset, -rocks[i].orbitRadius * sin(angle));
+            radius = max(radius, glm::length(p - center));
+        }
+        sectors.first.push_back(first);
+        sectors.count.push_back(rock - first);
+        sectors.localBounds.push_back(glm::vec4(center, radius + maxSize));
+    }
+    return sectors;
+}
 
-// Orbit data with eccentricity for elliptical paths
-struct OrbitData {
-    float semiMajor;
-    float eccentricity;
-    int segments;
+// Refit fixed index-range sectors of a longitude-sorted store; returns the summed sector radius so
+// the caller can re-sort once differential motion has smeared the sectors around the ring
+float refitStoreSectors(const SmallBodyStore& sb, BeltSectors& sectors, int sectorCount) {
+    sectors.first.clear();
+    sectors.count.clear();
+    sectors.localBounds.clear();
+    float radiusSum = 0.0f;
+    for (int s = 0; s < sectorCount; ++s) {
+        int first = (int)((long long)sb.count * s / sectorCount);
+        int end = (int)((long long)sb.count * (s + 1) / sectorCount);
+        if (end == first) continue;
+        glm::vec3 minPos(1e9f), maxPos(-1e9f);
+        float maxSize = 0.0f;
+        for (int i = first; i < end; ++i) {
+            glm::vec3 p(sb.x[i], sb.y[i], sb.z[i]);
+            minPos = glm::min(minPos, p);
+            maxPos = glm::max(maxPos, p);
+            maxSize = max(maxSize, sb.size[i]);
+        }
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+        float radius = glm::length(maxPos - center) + maxSize; // Box half-diagonal
+        sectors.first.push_back(first);
+        sectors.count.push_back(end - first);
+        sectors.localBounds.push_back(glm::vec4(center, radius));
+        radiusSum += radius;
+    }
+    return radiusSum;
+}
+
+// --- Utility: View Frustum ---
+// Planes extracted from projection * view (Gribb & Hartmann), normalized so distances are in world units
+struct Frustum {
+    glm::vec4 planes[6];
+    Frustum(const glm::mat4& viewProjection) {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[0] = row3 + row0; // Left
+        planes[1] = row3 - row0; // Right
+        planes[2] = row3 + row1; // Bottom
+        planes[3] = row3 - row1; // Top
+        planes[4] = row3 + row2; // Near
+        planes[5] = row3 - row2; // Far
+        for (glm::vec4& p : planes) p = p / glm::length(glm::vec3(p));
+    }
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& p : planes) {
+            if (glm::dot(glm::vec3(p), center) + p.w < -radius) return false;
+        }
+        return true;
+    }
 };
-OrbitData orbitParams[9] = {
-    {12.0f, 0.45f, 100},   // Mercury - very elliptical
-    {16.0f, 0.25f, 100},   // Venus - more elliptical
-    {22.0f, 0.30f, 100},   // Earth - more elliptical
-    {30.0f, 0.40f, 100},   // Mars - very elliptical
-    {50.0f, 0.25f, 100},   // Jupiter - more elliptical
-    {70.0f, 0.35f, 100},   // Saturn - more elliptical
-    {85.0f, 0.30f, 100},   // Uranus - more elliptical
-    {100.0f, 0.25f, 100},  // Neptune - more elliptical
-    {2.5f, 0.25f, 64}      // Moon - more elliptical
+
+// Collect runs of consecutive visible sectors as (firstInstance, instanceCount) pairs
+void visibleBeltRuns(const BeltSectors& sectors, const Frustum& frustum, float orbitAngleDeg, vector<pair<int, int>>& runs) {
+    runs.clear();
+    glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(orbitAngleDeg), glm::vec3(0.0f, 1.0f, 0.0f));
+    for (size_t s = 0; s < sectors.first.size(); ++s) {
+        const glm::vec4& bounds = sectors.localBounds[s];
+        glm::vec3 center = glm::vec3(rotation * glm::vec4(glm::vec3(bounds), 1.0f));
+        if (useFrustumCulling && !frustum.intersectsSphere(center, bounds.w)) {
+            cullStats.culled++;
+            continue;
+        }
+        cullStats.drawn++;
+        if (!runs.empty() && runs.back().first + runs.back().second == sectors.first[s])
+            runs.back().second += sectors.count[s];
+        else
+            runs.push_back(make_pair(sectors.first[s], sectors.count[s]));
+    }
+}
+
+// --- Multi-Draw Indirect ---
+// Sphere LODs, the marker sphere and Saturn's ring share one vertex layout, so their vertex and index
+// data are copied into a single buffer pair behind one VAO; a draw of any of them is then one command
+// in a glMultiDrawElementsIndirect call. Per-draw data (model matrix, colour, material) lives in an
+// SSBO. Attribute 3 is a per-instance uint from a static 0..MAX_DRAWS-1 buffer, so a command's
+// baseInstance is the index the vertex shader reads (gl_DrawID would need GL 4.6).
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
 };
 
-void createEllipticalOrbit(int planetIndex) {
-    vector<float> vertices;
-    vector<unsigned int> indices;
-    
-    float a = orbitParams[planetIndex].semiMajor;  // semi-major axis
-    float e = orbitParams[planetIndex].eccentricity; // eccentricity
-    float b = a * sqrt(1.0f - e * e); // semi-minor axis
-    int segments = orbitParams[planetIndex].segments;
-    
-    // Create dotted pattern like: . . . . . . . .
+struct IndirectDrawData {   // Mirrors DrawData in indirectVertexShaderSource (std430)
+    glm::mat4 model;
+    glm::vec4 color;        // rgb: marker colour
+    glm::vec4 params;       // x: opacity, y: transparent, z: marker
+    glm::vec4 layer;        // xy: UV scale, z: bodyTextures layer
+};
+
+const GLuint DRAW_DATA_SSBO_BINDING = 1;
+
+class IndirectDrawer {
+public:
+    static const int MAX_DRAWS = 1024;
+
+    struct MeshRange {
+        GLuint firstIndex, indexCount;
+        GLint baseVertex;
+    };
+
+    // Copies the 8-float vertex / uint index data of each source VAO into the shared buffers
+    void init(const vector<GLuint>& sourceVAOs) {
+        vector<pair<GLint, GLint>> buffers;
+        GLint vertexBytes = 0, indexBytes = 0;
+        for (GLuint vao : sourceVAOs) {
+            GLint vbo = 0, ebo = 0, vboSize = 0, eboSize = 0;
+            glBindVertexArray(vao);
+            glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vbo);
+            glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+            glGetNamedBufferParameteriv(vbo, GL_BUFFER_SIZE, &vboSize);
+            glGetNamedBufferParameteriv(ebo, GL_BUFFER_SIZE, &eboSize);
+            ranges[vao] = { (GLuint)(indexBytes / sizeof(GLuint)), (GLuint)(eboSize / sizeof(GLuint)), vertexBytes / VERTEX_BYTES };
+            buffers.push_back({ vbo, ebo });
+            vertexBytes += vboSize;
+            indexBytes += eboSize;
+        }
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+        for (size_t i = 0; i < sourceVAOs.size(); ++i) {
+            const MeshRange& r = ranges[sourceVAOs[i]];
+            GLint vboSize = 0;
+            glGetNamedBufferParameteriv(buffers[i].first, GL_BUFFER_SIZE, &vboSize);
+            glCopyNamedBufferSubData(buffers[i].first, vbo, 0, (GLintptr)r.baseVertex * VERTEX_BYTES, vboSize);
+            glCopyNamedBufferSubData(buffers[i].second, ebo, 0, (GLintptr)r.firstIndex * sizeof(GLuint), r.indexCount * sizeof(GLuint));
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        vector<GLuint> drawIndices(MAX_DRAWS);
+        for (int i = 0; i < MAX_DRAWS; ++i) drawIndices[i] = i;
+        glGenBuffers(1, &drawIndexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_BYTES, (void*)(6 * sizeof(float)));
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(3, 1);
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &dataBuffer);
+    }
+
+    GLuint sharedVAO() const { return vao; }
+    const MeshRange* range(GLuint sourceVAO) const {
+        auto it = ranges.find(sourceVAO);
+        return it == ranges.end() ? nullptr : &it->second;
+    }
+
+    // Each upload orphans the previous storage, so draws already issued keep their data
+    void uploadCommands(const vector<DrawElementsIndirectCommand>& commands) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+    }
+    void uploadDrawData(const vector<IndirectDrawData>& data) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(IndirectDrawData), data.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_SSBO_BINDING, dataBuffer);
+    }
+
+    // One submission for a belt's visible (baseInstance, count) runs of an instanced VAO
+    void drawRuns(GLuint instancedVAO, GLuint indexCount, const vector<pair<int, int>>& runs) {
+        if (runs.empty()) return;
+        vector<DrawElementsIndirectCommand> commands;
+        commands.reserve(runs.size());
+        unsigned long long triangles = 0;
+        for (const auto& run : runs) {
+            commands.push_back({ indexCount, (GLuint)run.second, 0, 0, (GLuint)run.first });
+            triangles += (unsigned long long)(indexCount / 3) * run.second;
+        }
+        uploadCommands(commands);
+        glStats.bindVertexArray(instancedVAO);
+        glStats.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)commands.size(), triangles);
+    }
+
+    void destroy() {
+        glDeleteVertexArrays(1, &vao);
+        GLuint buffers[5] = { vbo, ebo, drawIndexBuffer, commandBuffer, dataBuffer };
+        glDeleteBuffers(5, buffers);
+    }
+
+private:
+    static const int VERTEX_BYTES = 8 * sizeof(float);
+
+    unordered_map<GLuint, MeshRange> ranges; // By source VAO
+    GLuint vao = 0, vbo = 0, ebo = 0, drawIndexBuffer = 0;
+    GLuint commandBuffer = 0, dataBuffer = 0;
+};
+IndirectDrawer indirectDraws;
+bool useMultiDrawIndirect = true; // false = one glDrawElements per queued body / belt run (for comparison)
+
+// --- Render Queue ---
+// Scene bodies are submitted as DrawItems and drawn in the order of a 64-bit sort key rather than
+// submission order. Opaque items sort by program, then texture, then depth (front to back, for
+// early-Z within a run); transparent items by depth alone (back to front, so blending composites
+// correctly), then program and texture. execute() binds a program, texture or VAO only when it
+// differs from the previous item's, and re-applies material uniforms only when they change.
+//   opaque:      layer:2 | program:8 | texture:16 | depth:24 | sequence:14
+//   transparent: layer:2 | far-to-near depth:24 | program:8 | texture:16 | sequence:14
+struct DrawItem {
+    uint64_t key = 0;
+    Shader* shader = nullptr;
+    GLuint texture = 0;        // Array bound on unit 0; 0 = the program samples nothing (markers)
+    GLuint vao = 0;
+    GLsizei indexCount = 0;
+    glm::mat4 model = glm::mat4(1.0f);
+    bool transparent = false;
+    float opacity = 1.0f;
+    glm::vec3 color = glm::vec3(1.0f); // Marker items
+    glm::vec4 layer = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); // TextureStreamer::layerBinding() of the map in 'texture'
+};
+
+class RenderQueue {
+public:
+    enum Layer { LAYER_OPAQUE = 0, LAYER_TRANSPARENT = 1 };
+
+    unsigned int programBindsSkipped = 0, textureBindsSkipped = 0, vertexArrayBindsSkipped = 0; // This frame
+    unsigned int indirectSubmissions = 0, indirectFallbacks = 0;
+
+    void clear() {
+        items.clear();
+        sorted = true;
+        programBindsSkipped = textureBindsSkipped = vertexArrayBindsSkipped = 0;
+        indirectSubmissions = indirectFallbacks = 0;
+    }
+
+    // 'distance' is from the camera to the item; depth is quantised over [0, farPlane]
+    void submit(Layer layer, DrawItem item, float distance, float farPlane) {
+        item.transparent = layer == LAYER_TRANSPARENT;
+        uint64_t depth = (uint64_t)(glm::clamp(distance / farPlane, 0.0f, 1.0f) * 0xFFFFFF);
+        uint64_t program = slot(programs, item.shader) & 0xFF;
+        uint64_t texture = slot(textures, item.texture) & 0xFFFF;
+        uint64_t sequence = items.size() & 0x3FFF;
+        if (layer == LAYER_OPAQUE)
+            item.key = (program << 54) | (texture << 38) | (depth << 14) | sequence;
+        else
+            item.key = ((uint64_t)layer << 62) | ((0xFFFFFF - depth) << 38) | (program << 30) | (texture << 14) | sequence;
+        items.push_back(item);
+        sorted = false;
+    }
+
+    size_t size() const { return items.size(); }
+
+    // Draws every item of 'layer' in key order. apply(item, materialChanged) sets per-item uniforms;
+    // materialChanged is set when the program, transparency or opacity differs from the previous item.
+    template <typename Apply>
+    void execute(Layer layer, Apply apply) {
+        sortItems();
+        vector<const DrawItem*> layerItems;
+        for (const DrawItem& item : items)
+            if ((int)(item.key >> 62) == layer) layerItems.push_back(&item);
+        drawDirect(layerItems, apply);
+    }
+
+    // The same draws through IndirectDrawer: per-draw data in the SSBO, one glMultiDrawElementsIndirect
+    // per run of consecutive items sharing a texture (so the transparent order survives). 'program'
+    // is the indirect shader, which covers both the lit and the marker material. Markers sample
+    // nothing and join any run, so with every body in one array a pass is a single call.
+    // Items the drawer can't take (a VAO not given to IndirectDrawer::init, or past MAX_DRAWS) are
+    // drawn after the batch through execute()'s path with 'apply' (so they blend last), and counted
+    // in indirectFallbacks.
+    template <typename Apply>
+    void executeIndirect(Layer layer, Shader& program, IndirectDrawer& drawer, Apply apply) {
+        sortItems();
+        vector<IndirectDrawData> data;
+        vector<DrawElementsIndirectCommand> commands;
+        vector<GLuint> commandTextures;
+        vector<const DrawItem*> leftovers;
+        for (const DrawItem& item : items) {
+            if ((int)(item.key >> 62) != layer) continue;
+            const IndirectDrawer::MeshRange* range = drawer.range(item.vao);
+            if (!range || (int)data.size() == IndirectDrawer::MAX_DRAWS) {
+                leftovers.push_back(&item);
+                continue;
+            }
+            bool marker = item.texture == 0;
+            data.push_back({ item.model, glm::vec4(item.color, 1.0f),
+                             glm::vec4(item.opacity, item.transparent ? 1.0f : 0.0f, marker ? 1.0f : 0.0f, 0.0f),
+                             item.layer });
+            commands.push_back({ range->indexCount, 1, range->firstIndex, range->baseVertex, (GLuint)(data.size() - 1) });
+            commandTextures.push_back(item.texture);
+        }
+        if (!commands.empty()) {
+            drawer.uploadDrawData(data);
+            drawer.uploadCommands(commands);
+            program.use();
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindVertexArray(drawer.sharedVAO());
+            size_t start = 0;
+            while (start < commands.size()) {
+                size_t end = start;
+                GLuint runTexture = 0;
+                unsigned long long triangles = 0;
+                for (; end < commands.size(); triangles += commands[end++].count / 3) {
+                    if (commandTextures[end] == 0 || commandTextures[end] == runTexture) continue;
+                    if (runTexture != 0) break;
+                    runTexture = commandTextures[end];
+                }
+                if (runTexture != 0) glStats.bindTexture(GL_TEXTURE_2D_ARRAY, runTexture);
+                glStats.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLintptr)(start * sizeof(DrawElementsIndirectCommand)),
+                                                  (GLsizei)(end - start), triangles);
+                ++indirectSubmissions;
+                start = end;
+            }
+        }
+        if (leftovers.empty()) return;
+        if (!warnedFallback) {
+            cerr << "WARNING::RENDER_QUEUE:: " << leftovers.size() << " item(s) not batchable by multi-draw indirect; drawing them directly" << endl;
+            warnedFallback = true;
+        }
+        indirectFallbacks += (unsigned int)leftovers.size();
+        drawDirect(leftovers, apply);
+    }
+
+private:
+    // One glDrawElements per item, binding a program, texture or VAO only when it changes
+    template <typename Apply>
+    void drawDirect(const vector<const DrawItem*>& drawItems, Apply apply) {
+        const DrawItem* previous = nullptr;
+        Shader* boundShader = nullptr;
+        GLuint boundTexture = 0xFFFFFFFFu, boundVAO = 0xFFFFFFFFu;
+        glStats.activeTexture(GL_TEXTURE0);
+        for (const DrawItem* drawItem : drawItems) {
+            const DrawItem& item = *drawItem;
+            bool programChanged = item.shader != boundShader;
+            if (programChanged) {
+                item.shader->use();
+                boundShader = item.shader;
+            } else {
+                ++programBindsSkipped;
+            }
+            if (item.texture != 0) {
+                if (item.texture != boundTexture) {
+                    glStats.bindTexture(GL_TEXTURE_2D_ARRAY, item.texture);
+                    boundTexture = item.texture;
+                } else {
+                    ++textureBindsSkipped;
+                }
+            }
+            if (item.vao != boundVAO) {
+                glStats.bindVertexArray(item.vao);
+                boundVAO = item.vao;
+            } else {
+                ++vertexArrayBindsSkipped;
+            }
+            apply(item, programChanged || previous->transparent != item.transparent || previous->opacity != item.opacity);
+            glStats.drawElements(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT, 0);
+            previous = &item;
+        }
+    }
+
+    void sortItems() {
+        if (sorted) return;
+        sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+        sorted = true;
+    }
+
+    // Small stable indices for the key fields; the sets are tiny and persist across frames
+    template <typename T>
+    static uint64_t slot(vector<T>& values, T value) {
+        for (size_t i = 0; i < values.size(); ++i)
+            if (values[i] == value) return i;
+        values.push_back(value);
+        return values.size() - 1;
+    }
+
+    vector<DrawItem> items;
+    vector<Shader*> programs;
+    vector<GLuint> textures;
+    bool sorted = true;
+    bool warnedFallback = false;
+};
+RenderQueue renderQueue;
+
+// --- Simulation: Fixed-Timestep Thread ---
+// Everything the renderer needs from one tick. Published snapshots are never modified again.
+struct SimulationSnapshot {
+    double wallTime = 0.0;        // Simulation::now() this state belongs to
+    double simulationTime = 0.0;  // g_simulationTime at this tick
+    unsigned int layout = 0;      // Bumped when body or belt indices change; never blend across it
+    vector<glm::vec3> bodies;     // planetPositions layout
+    vector<float> beltX, beltY, beltZ, beltSize;
+    BeltSectors beltSectors;      // Padded by one tick of travel so blended positions stay inside
+    float tickMs = 0.0f;
+};
+
+// Advances the ephemeris and the inner belt at a fixed rate on its own thread and publishes
+// snapshots; the renderer blends the two most recent ones. tick() can also be driven directly.
+class Simulation {
+public:
+    static constexpr double TICK_SECONDS = 1.0 / 120.0;
+
+    void init(const Ephemeris& bodies, SmallBodyStore&& smallBodies) {
+        ephemeris = bodies;
+        belt = move(smallBodies);
+        belt.sortByLongitude(0.0);
+        propagateSmallBodies<LanesBest>(belt, 0.0);
+        BeltSectors sectors;
+        sectorRadiusAtSort = refitStoreSectors(belt, sectors, BELT_SECTOR_COUNT);
+        // Fastest possible body (periapsis speed) bounds how far any rock moves in one tick
+        for (int i = 0; i < belt.count; ++i) {
+            float speed = belt.a[i] * belt.n[i] * sqrt((1.0f + belt.e[i]) / (1.0f - belt.e[i]));
+            maxBeltSpeed = max(maxBeltSpeed, speed);
+        }
+    }
+
+    void setTimeScale(float scale) { timeScale.store(scale); }
+    int beltCount() const { return belt.count; }
+
+    // Applied at the start of the next tick
+    void setMoons(const vector<Moon>& moonList) {
+        lock_guard<mutex> lock(moonMutex);
+        pendingMoons = moonList;
+        moonsChanged = true;
+    }
+
+    void tick(double wallTime) {
+        advanceTo(simulationTime + TICK_SECONDS * timeScale.load(), wallTime);
+    }
+
+    // Evaluate and publish the state at an explicit simulation time (tick() steps by the time scale)
+    void advanceTo(double time, double wallTime) {
+        CpuZone zone("Simulation tick");
+        CpuZoneChain steps;
+        auto tickStart = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> lock(moonMutex);
+            if (moonsChanged) {
+                ephemeris.setMoons(FIRST_MOON_BODY, pendingMoons);
+                moonsChanged = false;
+                ++layout;
+            }
+        }
+        float travel = maxBeltSpeed * (float)(fabs(time - simulationTime) * 20.0);
+        simulationTime = time;
+        const double animation = simulationTime * 20.0;
+
+        // Reuse the snapshot retired last tick unless the renderer still holds it
+        shared_ptr<SimulationSnapshot> snap = (retired && retired.use_count() == 1) ? retired : make_shared<SimulationSnapshot>();
+        retired.reset();
+
+        steps.next("Ephemeris");
+        snap->bodies.resize(ephemeris.bodyCount());
+        ephemeris.positionsAt(animation, snap->bodies.data());
+
+        steps.next("Kepler belt");
+        propagateSmallBodies<LanesBest>(belt, animation);
+        steps.next("Belt sectors");
+        float radius = refitStoreSectors(belt, snap->beltSectors, BELT_SECTOR_COUNT);
+        if (radius > 2.0f * sectorRadiusAtSort) {
+            belt.sortByLongitude(animation);
+            sectorRadiusAtSort = refitStoreSectors(belt, snap->beltSectors, BELT_SECTOR_COUNT);
+            ++layout;
+        }
+        for (glm::vec4& bounds : snap->beltSectors.localBounds) bounds.w += travel;
+        steps.next("Snapshot copy");
+        snap->beltX.assign(belt.x.begin(), belt.x.begin() + belt.count);
+        snap->beltY.assign(belt.y.begin(), belt.y.begin() + belt.count);
+        snap->beltZ.assign(belt.z.begin(), belt.z.begin() + belt.count);
+        snap->beltSize.assign(belt.size.begin(), belt.size.begin() + belt.count);
+
+        snap->wallTime = wallTime;
+        snap->simulationTime = simulationTime;
+        snap->layout = layout;
+        snap->tickMs = chrono::duration<float, milli>(chrono::steady_clock::now() - tickStart).count();
+        steps.end();
+
+        lock_guard<mutex> lock(snapshotMutex);
+        retired = previous;
+        previous = current ? current : snap;
+        current = snap;
+    }
+
+    void start() {
+        running = true;
+        worker = thread(&Simulation::run, this);
+    }
+
+    void stop() {
+        running = false;
+        if (worker.joinable()) worker.join();
+    }
+
+    // The two most recent snapshots; both are the same object until the second tick
+    void latest(shared_ptr<const SimulationSnapshot>& older, shared_ptr<const SimulationSnapshot>& newer) const {
+        lock_guard<mutex> lock(snapshotMutex);
+        older = previous;
+        newer = current;
+    }
+
+    double now() const { return chrono::duration<double>(chrono::steady_clock::now() - epoch).count(); }
+
+private:
+    void run() {
+        cpuTrace.nameThread("Simulation");
+        auto tickDuration = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(TICK_SECONDS));
+        auto next = chrono::steady_clock::now() + tickDuration;
+        while (running) {
+            this_thread::sleep_until(next);
+            tick(chrono::duration<double>(next - epoch).count());
+            next += tickDuration;
+            // After a stall (debugger, suspended window) resume from now instead of replaying every tick
+            if (chrono::steady_clock::now() - next > chrono::milliseconds(250)) next = chrono::steady_clock::now();
+        }
+    }
+
+    Ephemeris ephemeris;
+    SmallBodyStore belt;
+    double simulationTime = 0.0;
+    unsigned int layout = 0;
+    float sectorRadiusAtSort = 0.0f;
+    float maxBeltSpeed = 0.0f;
+    atomic<float> timeScale{1.0f};
+    atomic<bool> running{false};
+    thread worker;
+    chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+    mutex moonMutex;
+    vector<Moon> pendingMoons;
+    bool moonsChanged = false;
+
+    mutable mutex snapshotMutex;
+    shared_ptr<SimulationSnapshot> previous, current, retired;
+};
+Simulation simulation;
+
+// --- Utility: Ring Geometry ---
+unsigned int ringVAO, ringVBO, ringIndexCount;
+void createRing(float innerRadius, float outerRadius, int segments) {
+    vector<float> vertices;
+    vector<unsigned int> indices;
+    for (int i = 0; i <= segments; ++i) {
+        float angle = (float)i / segments * 2.0f * M_PI;
+        float s = (float)i / segments;
+        vertices.push_back(cos(angle) * innerRadius);
+        vertices.push_back(0.0f);
+        vertices.push_back(sin(angle) * innerRadius);
+        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);
+        vertices.push_back(0.0f); vertices.push_back(s);
+        vertices.push_back(cos(angle) * outerRadius);
+        vertices.push_back(0.0f);
+        vertices.push_back(sin(angle) * outerRadius);
+        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);
+        vertices.push_back(1.0f); vertices.push_back(s);
+    }
+    for (int i = 0; i < segments; ++i) {
+        int i0 = i * 2; int i1 = i0 + 1; int i2 = i0 + 2; int i3 = i0 + 3;
+        indices.push_back(i0); indices.push_back(i1); indices.push_back(i2);
+        indices.push_back(i1); indices.push_back(i3); indices.push_back(i2);
+    }
+    ringIndexCount = static_cast<unsigned int>(indices.size());
+    glGenVertexArrays(1, &ringVAO);
+    glGenBuffers(1, &ringVBO);
+    unsigned int ringEBO;
+    glGenBuffers(1, &ringEBO);
+    glBindVertexArray(ringVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, ringVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ringEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ringIndexCount * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glBindVertexArray(0);
+}
+
+// --- Orbit Globals ---
+unsigned int orbitVAO[9], orbitVBO[9], orbitEBO[9], orbitIndexCount[9];
+
+// Ephemeris body traced by each orbit line; the Moon's slot follows the moon list (-1 = no Moon)
+struct OrbitData {
+    int body;
+    int segments;
+};
+OrbitData orbitParams[9] = {
+    {1, 100},   // Mercury
+    {2, 100},   // Venus
+    {3, 100},   // Earth
+    {4, 100},   // Mars
+    {5, 100},   // Jupiter
+    {6, 100},   // Saturn
+    {7, 100},   // Uranus
+    {8, 100},   // Neptune
+    {-1, 64}    // Moon
+};
+
+// Moon bodies are re-packed whenever the moon list changes, so re-find Earth's moon after each change
+void updateMoonOrbitBody() {
+    orbitParams[8].body = -1;
+    for (int i = 0; i < (int)moons.size(); ++i) {
+        if (moons[i].parentPlanet == 3) { orbitParams[8].body = FIRST_MOON_BODY + i; break; }
+    }
+}
+
+// Traces the body's ephemeris ellipse (relative to its parent, so the Sun sits at the focus)
+void createEllipticalOrbit(int planetIndex) {
+    vector<float> vertices;
+    vector<unsigned int> indices;
+    
+    int body = orbitParams[planetIndex].body;
+    int segments = orbitParams[planetIndex].segments;
+    
+    // Create dotted pattern like: . . . . . . . .
     // Draw 2 vertices for dot, skip 2 vertices for gap
     int dotSize = 2;      // vertices per dot
     int gapSize = 2;      // vertices per gap
     int patternSize = dotSize + gapSize;
     
     for (int i = 0; i <= segments; ++i) {
-        float angle = (float)i / segments * 2.0f * M_PI;
-        float x = a * cos(angle);
-        float z = b * sin(angle);
+        glm::vec3 p = ephemeris.orbitPoint(body, (double)i / segments * 2.0 * M_PI);
         
-        vertices.push_back(x);
-        vertices.push_back(0.0f);
-        vertices.push_back(z);
+        vertices.push_back(p.x);
+        vertices.push_back(p.y);
+        vertices.push_back(p.z);
     }
     
     // Create indices for dotted pattern
@@ -386,44 +2012,1152 @@ void createEllipticalOrbit(int planetIndex) {
     glBindVertexArray(0);
 }
 
-// --- Utility: Texture Loader ---
-unsigned int loadTexture(const char* path, bool hasAlpha) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format = GL_RGB;
-        if (nrComponents == 1) format = GL_RED;
-        else if (nrComponents == 3) format = GL_RGB;
-        else if (nrComponents == 4) format = GL_RGBA;
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        stbi_image_free(data);
-    } else {
-        cerr << "Texture failed to load at path: " << path << endl;
-        stbi_image_free(data);
+// --- Texture Cache (.stex) ---
+// "<image>.stex" holds a texture's full mip chain, block-compressed where it pays off. --bake-textures
+// writes it; at load time it is memory-mapped and uploaded as-is, with no decode and no glGenerateMipmap:
+//   3-channel maps, and 4-channel maps whose alpha is all opaque -> BC1 (4 bits/px)
+//   4-channel maps with real alpha -> BC3 (8 bits/px)
+//   1/2-channel maps -> raw (still with baked mips)
+// A cache is ignored (and the source decoded as before) if its source image changed after baking or
+// the GPU lacks S3TC.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum StexFormat : uint32_t { STEX_RAW = 0, STEX_BC1 = 1, STEX_BC3 = 2 };
+const uint32_t STEX_VERSION = 1;
+const int STEX_MAX_LEVELS = 16;
+
+struct StexHeader {
+    char magic[4];                   // "STEX"
+    uint32_t version;
+    uint32_t format;                 // StexFormat
+    uint32_t components;             // Source channels (bytes per pixel for raw levels)
+    uint32_t width, height, levels;
+    uint32_t reserved;
+    uint64_t sourceSize, sourceTime; // Stamp of the image it was baked from
+    uint64_t levelOffset[STEX_MAX_LEVELS];
+    uint64_t levelSize[STEX_MAX_LEVELS];
+};
+static_assert(sizeof(StexHeader) == 48 + 16 * STEX_MAX_LEVELS, "StexHeader must have no padding");
+
+string stexPath(const string& source) { return source + ".stex"; }
+
+bool sourceStamp(const string& path, uint64_t& size, uint64_t& time) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (uint64_t)st.st_size;
+    time = (uint64_t)st.st_mtime;
+    return true;
+}
+
+int mipLevelCount(int width, int height) {
+    int levels = 1;
+    while ((max(width, height) >> levels) > 0) ++levels;
+    return levels;
+}
+
+// Every level must be exactly the size its dimensions imply and lie inside the file; the upload
+// copies whole rows straight out of the mapping, so a short level would read past its end
+bool validStexHeader(const StexHeader& header, size_t fileSize) {
+    if (memcmp(header.magic, "STEX", 4) != 0 || header.version != STEX_VERSION || header.format > STEX_BC3 ||
+        header.components < 1 || header.components > 4 || header.width == 0 || header.height == 0 ||
+        header.width > 16384 || header.height > 16384 || header.levels == 0 ||
+        header.levels > (uint32_t)min(STEX_MAX_LEVELS, mipLevelCount(header.width, header.height)))
+        return false;
+    for (uint32_t i = 0; i < header.levels; ++i) {
+        uint64_t w = max(1u, header.width >> i), h = max(1u, header.height >> i);
+        uint64_t expected = header.format == STEX_RAW ? w * h * header.components
+                                                      : ((w + 3) / 4) * ((h + 3) / 4) * (header.format == STEX_BC3 ? 16 : 8);
+        if (header.levelSize[i] != expected || header.levelOffset[i] > fileSize || expected > fileSize - header.levelOffset[i])
+            return false;
+    }
+    return true;
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { unmap(); }
+
+    bool map(const string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) { unmap(); return false; }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) { unmap(); return false; }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps the file referenced
+        if (view == MAP_FAILED) return false;
+        data = (const unsigned char*)view;
+        size = (size_t)st.st_size;
+#endif
+        return data != nullptr;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// --- BC1/BC3 block encoders (used only by the baker) ---
+static uint16_t packRGB565(const float c[3]) {
+    int r = (int)(glm::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(glm::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(glm::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t v, float c[3]) {
+    c[0] = ((v >> 11) & 31) * 255.0f / 31.0f;
+    c[1] = ((v >> 5) & 63) * 255.0f / 63.0f;
+    c[2] = (v & 31) * 255.0f / 31.0f;
+}
+
+// 8-byte colour block: endpoints at the extremes of the block's principal axis, always 4-colour mode
+static void encodeColorBlock(const unsigned char px[16][4], unsigned char* out) {
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c) mean[c] += px[i][c] / 16.0f;
+    float cov[6] = { 0, 0, 0, 0, 0, 0 }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i) {
+        float d[3] = { px[i][0] - mean[0], px[i][1] - mean[1], px[i][2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+    float axis[3] = { 1, 1, 1 };
+    for (int iter = 0; iter < 8; ++iter) { // Power iteration
+        float n[3] = { cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                       cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                       cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+        float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len < 1e-6f) break; // Flat block: keep the grey axis
+        for (int c = 0; c < 3; ++c) axis[c] = n[c] / len;
+    }
+    float tMin = 1e9f, tMax = -1e9f;
+    for (int i = 0; i < 16; ++i) {
+        float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+        tMin = min(tMin, t);
+        tMax = max(tMax, t);
+    }
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + axis[c] * tMax;
+        e1[c] = mean[c] + axis[c] * tMin;
+    }
+    uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+    if (c0 < c1) swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        float palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDist = 1e30f;
+            for (int p = 0; p < 4; ++p) {
+                float dr = px[i][0] - palette[p][0], dg = px[i][1] - palette[p][1], db = px[i][2] - palette[p][2];
+                float dist = dr * dr + dg * dg + db * db;
+                if (dist < bestDist) { bestDist = dist; best = p; }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for (int b = 0; b < 4; ++b) out[4 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+// 8-byte BC3 alpha block: min/max endpoints, 8-value interpolation
+static void encodeAlphaBlock(const unsigned char px[16][4], unsigned char* out) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = max(a0, (int)px[i][3]);
+        a1 = min(a1, (int)px[i][3]);
+    }
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int palette[8] = { a0, a1 };
+        for (int p = 1; p < 7; ++p) palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            for (int p = 1; p < 8; ++p)
+                if (abs(px[i][3] - palette[p]) < abs(px[i][3] - palette[best])) best = p;
+            indices |= (uint64_t)best << (3 * i);
+        }
     }
-    return textureID;
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int b = 0; b < 6; ++b) out[2 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+// Compresses one level (3 or 4 channels) into BC1/BC3 blocks; rows of blocks are split across threads
+static vector<unsigned char> compressLevel(const unsigned char* pixels, int w, int h, int comps, StexFormat format) {
+    const int blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+    const int blockBytes = format == STEX_BC3 ? 16 : 8;
+    vector<unsigned char> out((size_t)blocksX * blocksY * blockBytes);
+    auto encodeRows = [&](int firstRow, int endRow) {
+        unsigned char block[16][4];
+        for (int by = firstRow; by < endRow; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                for (int i = 0; i < 16; ++i) { // Edge blocks repeat the last row/column
+                    int x = min(bx * 4 + (i & 3), w - 1), y = min(by * 4 + (i >> 2), h - 1);
+                    const unsigned char* p = pixels + ((size_t)y * w + x) * comps;
+                    block[i][0] = p[0]; block[i][1] = p[1]; block[i][2] = p[2];
+                    block[i][3] = comps == 4 ? p[3] : 255;
+                }
+                unsigned char* dst = &out[((size_t)by * blocksX + bx) * blockBytes];
+                if (format == STEX_BC3) {
+                    encodeAlphaBlock(block, dst);
+                    dst += 8;
+                }
+                encodeColorBlock(block, dst);
+            }
+        }
+    };
+    int threadCount = (int)min((unsigned)blocksY, max(1u, thread::hardware_concurrency()));
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+        threads.emplace_back(encodeRows, blocksY * t / threadCount, blocksY * (t + 1) / threadCount);
+    for (thread& t : threads) t.join();
+    return out;
 }
 
+// 2x2 box filter to the next mip level (a 1-pixel dimension stays 1)
+static vector<unsigned char> downsampleLevel(const vector<unsigned char>& src, int w, int h, int comps) {
+    int nw = max(1, w / 2), nh = max(1, h / 2);
+    vector<unsigned char> dst((size_t)nw * nh * comps);
+    for (int y = 0; y < nh; ++y) {
+        int y0 = min(2 * y, h - 1), y1 = min(2 * y + 1, h - 1);
+        for (int x = 0; x < nw; ++x) {
+            int x0 = min(2 * x, w - 1), x1 = min(2 * x + 1, w - 1);
+            for (int c = 0; c < comps; ++c) {
+                int sum = src[((size_t)y0 * w + x0) * comps + c] + src[((size_t)y0 * w + x1) * comps + c] +
+                          src[((size_t)y1 * w + x0) * comps + c] + src[((size_t)y1 * w + x1) * comps + c];
+                dst[((size_t)y * nw + x) * comps + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+bool bakeTexture(const string& path) {
+    int width, height, comps;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &comps, 0);
+    if (!data) {
+        cerr << "ERROR::BAKE:: Texture failed to load at path: " << path << endl;
+        return false;
+    }
+    vector<unsigned char> level(data, data + (size_t)width * height * comps);
+    stbi_image_free(data);
+
+    StexFormat format = STEX_RAW;
+    if (comps == 3) format = STEX_BC1;
+    if (comps == 4) {
+        bool opaque = true;
+        for (size_t i = 3; i < level.size() && opaque; i += 4) opaque = level[i] == 255;
+        format = opaque ? STEX_BC1 : STEX_BC3;
+    }
+
+    StexHeader header = {};
+    memcpy(header.magic, "STEX", 4);
+    header.version = STEX_VERSION;
+    header.format = format;
+    header.components = comps;
+    header.width = width;
+    header.height = height;
+    header.levels = min(mipLevelCount(width, height), STEX_MAX_LEVELS);
+    sourceStamp(path, header.sourceSize, header.sourceTime);
+
+    vector<vector<unsigned char>> levels;
+    int w = width, h = height;
+    uint64_t offset = sizeof(StexHeader);
+    for (uint32_t i = 0; i < header.levels; ++i) {
+        levels.push_back(format == STEX_RAW ? level : compressLevel(level.data(), w, h, comps, format));
+        header.levelOffset[i] = offset;
+        header.levelSize[i] = levels.back().size();
+        offset += (levels.back().size() + 15) & ~(uint64_t)15;
+        if (i + 1 < header.levels) {
+            level = downsampleLevel(level, w, h, comps);
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+    }
+
+    string outPath = stexPath(path);
+    FILE* file = fopen(outPath.c_str(), "wb");
+    if (!file) {
+        cerr << "ERROR::BAKE:: Could not write " << outPath << endl;
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    const unsigned char padding[16] = {};
+    for (uint32_t i = 0; i < header.levels && ok; ++i) {
+        ok = fwrite(levels[i].data(), 1, levels[i].size(), file) == levels[i].size();
+        size_t pad = (size_t)(((header.levelSize[i] + 15) & ~(uint64_t)15) - header.levelSize[i]);
+        if (pad) ok = ok && fwrite(padding, 1, pad, file) == pad;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        cerr << "ERROR::BAKE:: Failed writing " << outPath << endl;
+        return false;
+    }
+
+    static const char* formatNames[] = { "raw", "BC1", "BC3" };
+    double uncompressedMB = (double)width * height * comps * 4.0 / 3.0 / 1048576.0; // What glGenerateMipmap uploads
+    cout << "Baked " << outPath << ": " << width << "x" << height << " " << formatNames[format] << ", "
+         << header.levels << " levels, " << fixed << setprecision(1) << offset / 1048576.0 << " MB (was "
+         << uncompressedMB << " MB uncompressed)" << endl;
+    return true;
+}
+
+// The scene's texture set, for --bake-textures without file arguments
+const char* SCENE_TEXTURE_FILES[] = {
+    "sun.bmp", "mercury.bmp", "venus.bmp", "venus_atmosphere.bmp", "earth_daymap.bmp", "earth_clouds.bmp",
+    "moon.bmp", "mars.bmp", "jupiter.bmp", "saturn.bmp", "saturn_ring_alpha.bmp", "uranus.bmp",
+    "neptune.bmp", "star_milky_way.jpg"
+};
+
+int bakeTextures(vector<string> paths) {
+    if (paths.empty()) paths.assign(begin(SCENE_TEXTURE_FILES), end(SCENE_TEXTURE_FILES));
+    auto start = chrono::steady_clock::now();
+    int failures = 0;
+    for (const string& path : paths)
+        if (!bakeTexture(path)) ++failures;
+    cout << "Baked " << paths.size() - failures << "/" << paths.size() << " textures in " << fixed << setprecision(2)
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// --- Texture Streaming ---
+// request() hands back a reference to a texture name that is valid immediately: it starts out as a
+// shared 1x1 placeholder and is switched to the real texture once a loader thread has decoded the
+// image and update() has uploaded it. Call sites bind through the reference, so they pick up the
+// switch without changes. Requests are de-duplicated by path.
+// A baked .stex cache next to the image is mapped instead of decoded (see Texture Cache).
+// Uploads go through a persistently mapped PBO split into per-frame segments; update() copies at
+// most one segment's worth of rows (or rows of blocks) per frame, so large maps arrive in bands
+// over several frames instead of stalling one.
+// requestLayer() instead makes the map a layer of one GL_TEXTURE_2D_ARRAY shared by every body draw,
+// so any number of bodies can share a draw; such maps get no GL_TEXTURE_2D of their own. With S3TC
+// the array is BC3: layers come from their .stex blocks (BC1 gains an opaque alpha block) or are
+// compressed on the loader thread when there is no cache. Without it the array is RGBA8, mipmapped
+// on the GPU. The layer size is the largest such map (capped; bigger maps drop their top levels or
+// are box-filtered down); smaller maps sit in the layer's corner with edge-replicated padding and
+// are sampled with a per-layer UV scale (layerBinding()). The array is allocated once every layer
+// has been loaded; until all of it is uploaded, arrayTexture() and layerBinding() point at a
+// two-layer placeholder array instead.
+class TextureStreamer {
+public:
+    static const size_t UPLOAD_BUDGET_BYTES = 16u << 20; // Per frame (one staging segment)
+    static const int STAGING_SEGMENTS = 3;                // Frames the GPU may still be reading
+    static const int MAX_LAYER_WIDTH = 2048, MAX_LAYER_HEIGHT = 1024;
+
+    void start(int threadCount) {
+        startTime = chrono::steady_clock::now();
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; ++i) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) supportsS3TC = true;
+        }
+        compressedArray = supportsS3TC;
+        loaderThreads = threadCount;
+        for (int i = 0; i < threadCount; ++i)
+            workers.emplace_back(&TextureStreamer::workerLoop, this, i);
+    }
+
+    const unsigned int& request(const string& path, bool hasAlpha) {
+        auto known = byPath.find(path);
+        if (known != byPath.end()) return slots[known->second];
+        if (placeholders[0] == 0) createPlaceholders();
+
+        size_t index = slots.size();
+        slots.push_back(placeholders[hasAlpha ? 1 : 0]); // Transparent for alpha maps, so layers don't show as grey shells
+        byPath[path] = index;
+        {
+            lock_guard<mutex> lock(jobMutex);
+            jobs.push_back({ index, path, -1, hasAlpha });
+        }
+        jobReady.notify_one();
+        return slots[index];
+    }
+
+    // Adds the image as a layer of the body texture array and returns its index, or -1 once the
+    // array has been sized (every layer must be requested before the layers finish loading)
+    int requestLayer(const string& path, bool hasAlpha) {
+        auto known = layerByPath.find(path);
+        if (known != layerByPath.end()) return known->second;
+        if (bodyArray != 0) {
+            cerr << "ERROR::TEXTURE:: " << path << " requested as a layer after the array was sized" << endl;
+            return -1;
+        }
+        if (placeholderArray == 0) createPlaceholderArray();
+        int layer = layerCount++;
+        layerByPath[path] = layer;
+        layerScales.push_back(glm::vec2(1.0f));
+        layerHasAlpha.push_back(hasAlpha);
+        {
+            lock_guard<mutex> lock(jobMutex);
+            jobs.push_back({ 0, path, layer, hasAlpha });
+        }
+        jobReady.notify_one();
+        return layer;
+    }
+
+    bool layersReady() const { return layerCount > 0 && layersDone == layerCount; }
+    // Bind on GL_TEXTURE_2D_ARRAY and sample with layerBinding(); both switch to the real array together
+    unsigned int arrayTexture() const { return layersReady() ? bodyArray : placeholderArray; }
+    // xy: UV scale, z: array layer (the grey or transparent placeholder layer until the array is ready)
+    glm::vec4 layerBinding(int layer) const {
+        if (!layersReady()) return glm::vec4(1.0f, 1.0f, layerHasAlpha[layer] ? 1.0f : 0.0f, 0.0f);
+        return glm::vec4(layerScales[layer].x, layerScales[layer].y, (float)layer, 0.0f);
+    }
+    int layerWidth() const { return arrayWidth; }
+    int layerHeight() const { return arrayHeight; }
+    int layers() const { return layerCount; }
+    bool arrayCompressed() const { return compressedArray; }
+    size_t arrayBytes() const { return arrayByteSize; }
+    double arrayUploadMs() const { return layerUploadMs; }
+
+    // GL thread, once per frame: upload up to 'budget' bytes of decoded rows
+    void update(size_t budget = UPLOAD_BUDGET_BYTES) {
+        {
+            lock_guard<mutex> lock(decodedMutex);
+            while (!decoded.empty()) {
+                if (decoded.front().layer >= 0) parkedLayers.push_back(decoded.front());
+                else uploads.push_back(decoded.front());
+                decoded.pop_front();
+            }
+        }
+        // The array's size depends on every layer, so layers wait until the last one is decoded
+        if (layerCount > 0 && bodyArray == 0 && (int)parkedLayers.size() == layerCount) {
+            createArray();
+            for (Upload& u : parkedLayers) uploads.push_back(u);
+            parkedLayers.clear();
+        }
+        if (uploads.empty()) return;
+        CpuZone zone("Texture uploads");
+        budget = min(budget, UPLOAD_BUDGET_BYTES);
+        if (pbo == 0) createStaging();
+
+        // The GPU finished with this segment STAGING_SEGMENTS frames ago, so this rarely waits
+        if (fences[segment]) {
+            while (glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fences[segment]);
+            fences[segment] = 0;
+        }
+        const size_t segmentOffset = (size_t)segment * UPLOAD_BUDGET_BYTES;
+        size_t used = 0;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows are packed tightly in the PBO
+        while (!uploads.empty() && used < budget) {
+            Upload& u = uploads.front();
+            if (u.levels == 0) { // Load failed; the placeholder stays
+                uploads.pop_front();
+                markFailed();
+                continue;
+            }
+            if (u.layer >= 0) { // Layers never fail: a missing map arrives as a 1x1 placeholder texel
+                used = uploadLayerRows(u, segmentOffset, used, budget);
+                if (u.level < arrayUploadLevels) continue;
+                layerScales[u.layer] = glm::vec2((float)u.width / arrayWidth, (float)u.height / arrayHeight);
+                if (u.file) ++fromCache;
+                uploads.pop_front();
+                markResident();
+                layerDone();
+                continue;
+            }
+            if (u.texture == 0) {
+                glGenTextures(1, &u.texture);
+                glBindTexture(GL_TEXTURE_2D, u.texture);
+                glTexStorage2D(GL_TEXTURE_2D, u.decoded ? mipLevelCount(u.width, u.height) : u.levels,
+                               u.compressedFormat ? u.compressedFormat : sizedFormat(u.components), u.width, u.height);
+            }
+            // A "row" is a pixel row, or a row of 4x4 blocks in a compressed level
+            int levelWidth = max(1, u.width >> u.level), levelHeight = max(1, u.height >> u.level);
+            int rowHeight = u.compressedFormat ? 4 : 1;
+            size_t rowBytes = u.compressedFormat ? (size_t)((levelWidth + 3) / 4) * u.blockBytes
+                                                 : (size_t)levelWidth * u.components;
+            int totalRows = (levelHeight + rowHeight - 1) / rowHeight;
+            int rows = min(totalRows - u.rowsDone, (int)((budget - used) / rowBytes));
+            if (rows == 0) {
+                if (used > 0) break; // Next frame
+                rows = 1;            // A single row wider than the budget still has to go
+            }
+            memcpy(mapped + segmentOffset + used, u.levelData[u.level] + u.rowsDone * rowBytes, rows * rowBytes);
+            glBindTexture(GL_TEXTURE_2D, u.texture);
+            int y = u.rowsDone * rowHeight;
+            int height = min(rows * rowHeight, levelHeight - y);
+            if (u.compressedFormat)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, u.level, 0, y, levelWidth, height, u.compressedFormat,
+                                          (GLsizei)(rows * rowBytes), (void*)(segmentOffset + used));
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, u.level, 0, y, levelWidth, height, pixelFormat(u.components), GL_UNSIGNED_BYTE,
+                                (void*)(segmentOffset + used));
+            used = (used + rows * rowBytes + 15) & ~(size_t)15;
+            bytesUploaded += rows * rowBytes;
+            u.rowsDone += rows;
+            if (u.rowsDone < totalRows) continue;
+            u.rowsDone = 0;
+            if (++u.level < u.levels) continue;
+
+            if (u.decoded) glGenerateMipmap(GL_TEXTURE_2D); // No baked mips
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            slots[u.slot] = u.texture;
+            if (u.file) ++fromCache;
+            stbi_image_free(u.pixels);
+            uploads.pop_front();
+            markResident();
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glStats.invalidate(); // Texture binds above bypass the wrappers
+        if (used > 0) {
+            fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            segment = (segment + 1) % STAGING_SEGMENTS;
+        }
+    }
+
+    // Blocks until every requested texture is resident (or failed); for runs that must not show placeholders
+    void finishAll() {
+        CpuZone zone("Texture finishAll");
+        while (true) {
+            update();
+            if (uploads.empty()) {
+                unique_lock<mutex> lock(decodedMutex);
+                if (decodesDone == (int)slots.size() + layerCount && decoded.empty() && parkedLayers.empty()) break;
+                decodedReady.wait(lock, [this] { return !decoded.empty(); });
+            }
+        }
+    }
+
+    int pending() const { return (int)slots.size() + layerCount - resident - failed; }
+
+    ~TextureStreamer() { stopWorkers(); } // Early exits skip shutdown(); joinable threads would terminate()
+
+    void shutdown() {
+        stopWorkers();
+        for (Upload& u : decoded) stbi_image_free(u.pixels);
+        for (Upload& u : uploads) {
+            stbi_image_free(u.pixels);
+            glDeleteTextures(1, &u.texture);
+        }
+        decoded.clear();
+        uploads.clear();
+        for (int i = 0; i < STAGING_SEGMENTS; ++i)
+            if (fences[i]) glDeleteSync(fences[i]);
+        if (pbo) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &pbo);
+        }
+        for (unsigned int t : slots)
+            if (t != placeholders[0] && t != placeholders[1]) glDeleteTextures(1, &t);
+        glDeleteTextures(2, placeholders);
+        glDeleteTextures(1, &bodyArray);
+        glDeleteTextures(1, &placeholderArray);
+        parkedLayers.clear();
+    }
+
+private:
+    struct Job { size_t slot; string path; int layer; bool hasAlpha; };
+    struct Upload {
+        size_t slot = 0;
+        unsigned char* pixels = nullptr;  // stb-decoded source (uncached path)
+        shared_ptr<MappedFile> file;      // Mapped .stex (cached path)
+        GLenum compressedFormat = 0;      // 0 = uncompressed rows
+        int blockBytes = 0;
+        int width = 0, height = 0, components = 0;
+        int levels = 0;                   // 0 = load failed
+        bool decoded = false;             // Single decoded level; the rest come from glGenerateMipmap
+        const unsigned char* levelData[STEX_MAX_LEVELS] = {};
+        unsigned int texture = 0;
+        int level = 0, rowsDone = 0;      // Upload progress
+        int layer = -1;                   // Body array layer, or -1 for a GL_TEXTURE_2D slot
+        shared_ptr<vector<unsigned char>> layerPixels; // A layer's RGBA rows or BC3 levels, padded on upload
+    };
+
+    deque<unsigned int> slots; // Deque: references handed out stay valid as it grows
+    unordered_map<string, size_t> byPath;
+    unsigned int placeholders[2] = { 0, 0 }; // Opaque grey, transparent
+    int resident = 0;
+    int failed = 0; // Loads that kept their placeholder
+    int fromCache = 0;
+    size_t bytesUploaded = 0;
+    bool supportsS3TC = false;
+    chrono::steady_clock::time_point startTime;
+
+    unordered_map<string, int> layerByPath;
+    vector<glm::vec2> layerScales;
+    vector<bool> layerHasAlpha;
+    int layerCount = 0, layersDone = 0;
+    deque<Upload> parkedLayers; // Loaded layers waiting for the rest
+    unsigned int bodyArray = 0, placeholderArray = 0;
+    bool compressedArray = false; // BC3 (S3TC available) or RGBA8; fixed at start()
+    int arrayWidth = 0, arrayHeight = 0;
+    int arrayUploadLevels = 1;    // Levels uploaded per layer; RGBA8 uploads level 0 and generates the rest
+    size_t arrayByteSize = 0;
+    chrono::steady_clock::time_point arrayStart;
+    double layerUploadMs = 0.0;
+    int loaderThreads = 0;
+
+    vector<thread> workers;
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<Job> jobs;
+    bool stopping = false;
+
+    mutex decodedMutex;
+    condition_variable decodedReady;
+    deque<Upload> decoded; // Worker -> GL thread
+    int decodesDone = 0;
+    deque<Upload> uploads; // GL thread only; front may be part-uploaded
+
+    unsigned int pbo = 0;
+    unsigned char* mapped = nullptr;
+    GLsync fences[STAGING_SEGMENTS] = {};
+    int segment = 0;
+
+    static GLenum pixelFormat(int components) {
+        return components == 1 ? GL_RED : components == 2 ? GL_RG : components == 3 ? GL_RGB : GL_RGBA;
+    }
+    static GLenum sizedFormat(int components) {
+        return components == 1 ? GL_R8 : components == 2 ? GL_RG8 : components == 3 ? GL_RGB8 : GL_RGBA8;
+    }
+
+    void createPlaceholders() {
+        const unsigned char texels[2][4] = { { 128, 128, 128, 255 }, { 0, 0, 0, 0 } };
+        glGenTextures(2, placeholders);
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, placeholders[i]);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+    }
+
+    // Layer 0: opaque grey, layer 1: transparent, as the 2D placeholders
+    void createPlaceholderArray() {
+        const unsigned char texels[2][4] = { { 128, 128, 128, 255 }, { 0, 0, 0, 0 } };
+        glGenTextures(1, &placeholderArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, placeholderArray);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, 1, 1, 2);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, 2, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void createArray() {
+        for (const Upload& u : parkedLayers) {
+            arrayWidth = max(arrayWidth, u.width);
+            arrayHeight = max(arrayHeight, u.height);
+        }
+        int levels = mipLevelCount(arrayWidth, arrayHeight);
+        arrayUploadLevels = compressedArray ? levels : 1;
+        for (int level = 0; level < levels; ++level) {
+            size_t w = max(1, arrayWidth >> level), h = max(1, arrayHeight >> level);
+            arrayByteSize += (compressedArray ? ((w + 3) / 4) * ((h + 3) / 4) * 16 : w * h * 4) * layerCount;
+        }
+        glGenTextures(1, &bodyArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, bodyArray);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, compressedArray ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8,
+                       arrayWidth, arrayHeight, layerCount);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT); // Full-size layers wrap as the 2D maps did
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        arrayStart = chrono::steady_clock::now();
+    }
+
+    // Copies a band of full-width rows (of pixels, or of 4x4 blocks when compressed) of the layer's
+    // current level into the staging segment, replicating the map's last column and row into the
+    // padding, and issues the upload; returns the new 'used'. A map with fewer levels than the array
+    // repeats its smallest one; loadLayer() only hands over full mip chains, so that level is never
+    // wider or taller than the array level, but the copy is clipped to the staging row regardless.
+    size_t uploadLayerRows(Upload& u, size_t segmentOffset, size_t used, size_t budget) {
+        const int texelSize = compressedArray ? 4 : 1;     // Pixels per row / column unit
+        const size_t unitBytes = compressedArray ? 16 : 4;
+        int srcLevel = min(u.level, u.levels - 1);
+        int levelWidth = max(1, arrayWidth >> u.level), levelHeight = max(1, arrayHeight >> u.level);
+        int srcWidth = max(1, u.width >> srcLevel), srcHeight = max(1, u.height >> srcLevel);
+        int columns = (levelWidth + texelSize - 1) / texelSize, totalRows = (levelHeight + texelSize - 1) / texelSize;
+        int srcColumns = (srcWidth + texelSize - 1) / texelSize, srcRows = (srcHeight + texelSize - 1) / texelSize;
+        const size_t rowBytes = columns * unitBytes, srcRowBytes = srcColumns * unitBytes;
+        int rows = min(totalRows - u.rowsDone, (int)((budget - used) / rowBytes));
+        if (rows == 0) {
+            if (used > 0) return budget; // Next frame
+            rows = 1;
+        }
+        unsigned char* dst = mapped + segmentOffset + used;
+        for (int r = 0; r < rows; ++r, dst += rowBytes) {
+            const unsigned char* src = u.levelData[srcLevel] + (size_t)min(u.rowsDone + r, srcRows - 1) * srcRowBytes;
+            int copied = min(srcColumns, columns);
+            memcpy(dst, src, copied * unitBytes);
+            for (int x = copied; x < columns; ++x) memcpy(dst + x * unitBytes, src + (copied - 1) * unitBytes, unitBytes);
+        }
+        int y = u.rowsDone * texelSize, height = min(rows * texelSize, levelHeight - y);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, bodyArray);
+        if (compressedArray)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, u.level, 0, y, u.layer, levelWidth, height, 1,
+                                      GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, (GLsizei)(rows * rowBytes), (void*)(segmentOffset + used));
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, u.level, 0, y, u.layer, levelWidth, height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            (void*)(segmentOffset + used));
+        bytesUploaded += rows * rowBytes;
+        u.rowsDone += rows;
+        if (u.rowsDone == totalRows) {
+            u.rowsDone = 0;
+            ++u.level;
+        }
+        return (used + rows * rowBytes + 15) & ~(size_t)15;
+    }
+
+    void markResident() {
+        ++resident;
+        reportIfSettled();
+    }
+    void markFailed() {
+        ++failed;
+        reportIfSettled();
+    }
+
+    // Prints the summary once every request has either become resident or failed
+    void reportIfSettled() {
+        if (resident + failed < (int)slots.size() + layerCount) return;
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+        cout << "Textures: " << resident << " resident";
+        if (failed > 0) cout << " (" << failed << " failed)";
+        cout << " after " << fixed << setprecision(0) << ms
+             << " ms (" << loaderThreads << " loader threads, " << fromCache << " from .stex cache, "
+             << bytesUploaded / 1048576 << " MB uploaded)" << endl;
+    }
+
+    // A layer finished uploading; the last one completes the array
+    void layerDone() {
+        if (++layersDone < layerCount) return;
+        if (!compressedArray) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, bodyArray);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        layerUploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - arrayStart).count();
+        cout << "Texture array: " << layerCount << " layers of " << arrayWidth << "x" << arrayHeight << " "
+             << (compressedArray ? "BC3" : "RGBA8") << ", " << fixed << setprecision(1) << arrayBytes() / 1048576.0
+             << " MB with mips, uploaded in " << setprecision(0) << layerUploadMs << " ms" << endl;
+    }
+
+    void createStaging() {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr size = (GLsizeiptr)(UPLOAD_BUDGET_BYTES * STAGING_SEGMENTS);
+        glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        if (!mapped) cerr << "ERROR::TEXTURE:: Failed to map the staging buffer" << endl;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // Fills 'u' from "<path>.stex" if it exists, is intact, is not older than its source and the GPU can use it
+    bool mapCache(const string& path, Upload& u) {
+        CpuZone zone("Texture cache map");
+        shared_ptr<MappedFile> file = make_shared<MappedFile>();
+        if (!file->map(stexPath(path)) || file->size < sizeof(StexHeader)) return false;
+        StexHeader header;
+        memcpy(&header, file->data, sizeof(header));
+        if (!validStexHeader(header, file->size)) {
+            cerr << "WARNING::TEXTURE:: Ignoring malformed cache " << stexPath(path) << endl;
+            return false;
+        }
+        uint64_t size, time;
+        if (sourceStamp(path, size, time) && (size != header.sourceSize || time != header.sourceTime)) {
+            cerr << "WARNING::TEXTURE:: " << stexPath(path) << " is stale; re-run --bake-textures" << endl;
+            return false;
+        }
+        if (header.format != STEX_RAW && !supportsS3TC) return false;
+
+        u.width = header.width;
+        u.height = header.height;
+        u.components = header.components;
+        u.levels = header.levels;
+        u.compressedFormat = header.format == STEX_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                           : header.format == STEX_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+        u.blockBytes = header.format == STEX_BC3 ? 16 : 8;
+        for (uint32_t i = 0; i < header.levels; ++i) u.levelData[i] = file->data + header.levelOffset[i];
+        u.file = file;
+        return true;
+    }
+
+    // Fills a layer in the array's format: BC3 levels (from the .stex cache when it holds blocks and a
+    // full mip chain, else compressed here) or one RGBA8 level. A map that fails to load becomes a
+    // single texel of the matching placeholder colour, so every layer takes the same upload path.
+    void loadLayer(const string& path, bool hasAlpha, Upload& u) {
+        bool cached = compressedArray && mapCache(path, u) && u.compressedFormat;
+        if (cached && u.levels < mipLevelCount(u.width, u.height)) {
+            // The array's smaller levels repeat a layer's last one, which must not outgrow them
+            cerr << "WARNING::TEXTURE:: " << stexPath(path) << " has a partial mip chain; re-run --bake-textures" << endl;
+            cached = false;
+        }
+        if (cached) {
+            int skip = 0; // Baked mips make the size cap free: start at the first level that fits
+            while (skip + 1 < u.levels && ((u.width >> skip) > MAX_LAYER_WIDTH || (u.height >> skip) > MAX_LAYER_HEIGHT)) ++skip;
+            u.width = max(1, u.width >> skip);
+            u.height = max(1, u.height >> skip);
+            u.levels -= skip;
+            for (int i = 0; i < u.levels; ++i) u.levelData[i] = u.levelData[i + skip];
+            if (u.compressedFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) widenToBC3(u);
+            return;
+        }
+        Upload fresh;
+        fresh.layer = u.layer;
+        u = fresh; // A raw or unusable cache may have filled some fields
+
+        CpuZone zone("Texture layer decode");
+        int components;
+        vector<unsigned char> pixels;
+        unsigned char* data = stbi_load(path.c_str(), &u.width, &u.height, &components, 4);
+        bool loaded = data != nullptr;
+        if (loaded) {
+            pixels.assign(data, data + (size_t)u.width * u.height * 4);
+            stbi_image_free(data);
+        } else {
+            cerr << "Texture failed to load at path: " << path << endl;
+            pixels = hasAlpha ? vector<unsigned char>{ 0, 0, 0, 0 } : vector<unsigned char>{ 128, 128, 128, 255 };
+            u.width = u.height = 1;
+        }
+        while (u.width > MAX_LAYER_WIDTH || u.height > MAX_LAYER_HEIGHT) {
+            pixels = downsampleLevel(pixels, u.width, u.height, 4);
+            u.width = max(1, u.width / 2);
+            u.height = max(1, u.height / 2);
+        }
+        u.components = 4;
+        if (!compressedArray) {
+            u.layerPixels = make_shared<vector<unsigned char>>(move(pixels));
+            u.levels = 1;
+            u.decoded = true;
+            u.levelData[0] = u.layerPixels->data();
+            return;
+        }
+        if (loaded) cerr << "WARNING::TEXTURE:: No .stex cache for " << path << "; compressing at startup (see --bake-textures)" << endl;
+        u.levels = min(mipLevelCount(u.width, u.height), STEX_MAX_LEVELS);
+        u.layerPixels = make_shared<vector<unsigned char>>();
+        size_t offsets[STEX_MAX_LEVELS];
+        int w = u.width, h = u.height;
+        for (int level = 0; level < u.levels; ++level) {
+            vector<unsigned char> blocks = compressLevel(pixels.data(), w, h, 4, STEX_BC3);
+            offsets[level] = u.layerPixels->size();
+            u.layerPixels->insert(u.layerPixels->end(), blocks.begin(), blocks.end());
+            if (level + 1 == u.levels) break;
+            pixels = downsampleLevel(pixels, w, h, 4);
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+        for (int level = 0; level < u.levels; ++level) u.levelData[level] = u.layerPixels->data() + offsets[level];
+        u.compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        u.blockBytes = 16;
+    }
+
+    // BC3 = an alpha block followed by a BC1 colour block. The baker writes only 4-colour BC1 blocks
+    // (or flat ones, index 0 throughout), which BC3 decodes identically, so an opaque alpha block is
+    // all a BC1 layer needs
+    void widenToBC3(Upload& u) {
+        static const unsigned char opaqueAlpha[8] = { 255, 255, 0, 0, 0, 0, 0, 0 };
+        size_t levelBytes[STEX_MAX_LEVELS], total = 0;
+        for (int i = 0; i < u.levels; ++i) {
+            size_t w = max(1, u.width >> i), h = max(1, u.height >> i);
+            levelBytes[i] = ((w + 3) / 4) * ((h + 3) / 4) * 8;
+            total += levelBytes[i] * 2;
+        }
+        u.layerPixels = make_shared<vector<unsigned char>>(total);
+        unsigned char* dst = u.layerPixels->data();
+        for (int i = 0; i < u.levels; ++i) {
+            const unsigned char* src = u.levelData[i];
+            u.levelData[i] = dst;
+            for (size_t b = 0; b < levelBytes[i]; b += 8, dst += 16) {
+                memcpy(dst, opaqueAlpha, 8);
+                memcpy(dst + 8, src + b, 8);
+            }
+        }
+        u.compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        u.blockBytes = 16;
+    }
+
+    void stopWorkers() {
+        {
+            lock_guard<mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (thread& t : workers) t.join();
+        workers.clear();
+    }
+
+    void workerLoop(int index) {
+        cpuTrace.nameThread(("Texture loader " + to_string(index)).c_str());
+        while (true) {
+            Job job;
+            {
+                unique_lock<mutex> lock(jobMutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            Upload u;
+            u.slot = job.slot;
+            u.layer = job.layer;
+            if (u.layer >= 0) {
+                loadLayer(job.path, job.hasAlpha, u);
+            } else if (!mapCache(job.path, u)) {
+                CpuZone zone("Texture decode");
+                u.pixels = stbi_load(job.path.c_str(), &u.width, &u.height, &u.components, 0);
+                if (u.pixels) {
+                    u.levels = 1;
+                    u.decoded = true;
+                    u.levelData[0] = u.pixels;
+                } else {
+                    cerr << "Texture failed to load at path: " << job.path << endl;
+                }
+            }
+            {
+                lock_guard<mutex> lock(decodedMutex);
+                decoded.push_back(u);
+                ++decodesDone;
+            }
+            decodedReady.notify_one();
+        }
+    }
+};
+TextureStreamer textures;
+
+// --- Render Target Pool ---
+// Single-attachment targets for the post chain, keyed by size and format. A pass acquires a target,
+// renders into it and releases it after its last reader has been issued; a later pass with the same
+// description then reuses it (GL orders the commands, so reuse within a frame is safe).
+// Targets nobody has acquired for DROP_AFTER_FRAMES frames are freed.
+struct RenderTargetDesc {
+    int width = 0, height = 0;
+    GLenum internalFormat = GL_RGBA16F;
+
+    bool operator==(const RenderTargetDesc& o) const {
+        return width == o.width && height == o.height && internalFormat == o.internalFormat;
+    }
+};
+
+struct RenderTarget {
+    RenderTargetDesc desc;
+    unsigned int fbo = 0, texture = 0;
+    size_t bytes = 0;
+    bool inUse = false;
+    unsigned long long lastUsedFrame = 0;
+};
+
+class RenderTargetPool {
+public:
+    static const int DROP_AFTER_FRAMES = 120;
+    unsigned int reusedLastFrame = 0;   // Acquires served by an existing target
+    unsigned int createdLastFrame = 0;  // Acquires that had to allocate
+
+    RenderTarget* acquire(const RenderTargetDesc& desc) {
+        for (const unique_ptr<RenderTarget>& t : targets) {
+            if (t->inUse || !(t->desc == desc)) continue;
+            t->inUse = true;
+            t->lastUsedFrame = frame;
+            ++reused;
+            return t.get();
+        }
+        targets.push_back(unique_ptr<RenderTarget>(new RenderTarget()));
+        RenderTarget& t = *targets.back();
+        t.desc = desc;
+        t.bytes = (size_t)desc.width * desc.height * bytesPerPixel(desc.internalFormat);
+        t.inUse = true;
+        t.lastUsedFrame = frame;
+
+        glGenTextures(1, &t.texture);
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        GLint previousFbo = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+        glGenFramebuffers(1, &t.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cerr << "ERROR::FRAMEBUFFER:: pooled " << desc.width << "x" << desc.height << " target is not complete!" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFbo);
+        glStats.invalidate(); // Texture and read framebuffer changed outside the wrappers
+        ++created;
+        return &t;
+    }
+
+    void release(RenderTarget* t) {
+        if (!t) return;
+        t->inUse = false;
+        t->lastUsedFrame = frame;
+    }
+
+    // Once per frame, after the last release: frees targets that have sat idle too long
+    void endFrame() {
+        for (size_t i = 0; i < targets.size();) {
+            RenderTarget& t = *targets[i];
+            if (!t.inUse && frame - t.lastUsedFrame > DROP_AFTER_FRAMES) {
+                destroy(t);
+                targets.erase(targets.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+        reusedLastFrame = reused;
+        createdLastFrame = created;
+        reused = created = 0;
+        ++frame;
+    }
+
+    void clear() {
+        for (const unique_ptr<RenderTarget>& t : targets) destroy(*t);
+        targets.clear();
+    }
+
+    size_t count() const { return targets.size(); }
+    size_t bytes() const {
+        size_t total = 0;
+        for (const unique_ptr<RenderTarget>& t : targets) total += t->bytes;
+        return total;
+    }
+
+private:
+    vector<unique_ptr<RenderTarget>> targets;
+    unsigned long long frame = 0;
+    unsigned int reused = 0, created = 0;
+
+    static size_t bytesPerPixel(GLenum format) {
+        switch (format) {
+            case GL_RGBA16F: return 8;
+            case GL_R11F_G11F_B10F:
+            case GL_RGBA8: return 4;
+            default: return 16;
+        }
+    }
+
+    static void destroy(RenderTarget& t) {
+        glDeleteFramebuffers(1, &t.fbo);
+        glDeleteTextures(1, &t.texture);
+    }
+};
+
 // --- Post-Processing Globals ---
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
-unsigned int fboScene, texSceneColor, texBrightMap, rboDepth;
-unsigned int fboBloom[2], texBloom[2];
-unsigned int fboGodRays, texGodRays;
-unsigned int fboComposite, texComposite;
-unsigned int fboFinal, texFinal; // We still declare them, just won't use fboFinal
-unsigned int texNoise;
+// The scene targets live for the whole frame, so they are owned directly rather than pooled
+unsigned int fboScene, texSceneColor, texBrightMap, texSceneDepth; // Depth is a texture so the god-ray upsample can read it
+size_t sceneTargetBytes = 0;
+RenderTargetPool renderTargets;
+// Bloom mip chain (pooled): level 0 is half resolution, each further level halves again
+const int BLOOM_MIP_COUNT = 6;
+int godRayDownscale = 2; // 2 = half resolution, 4 = quarter (shares the pool's bloom level 1)
+int godRaySamples = 48;  // Per low-resolution texel
+// Compute post chain (--compute-post): quarter-resolution bloom blurred in shared-memory tiles, then a
+// single dispatch doing composite + tone mapping + gamma straight into the final LDR target
+bool useComputePost = false;
+
+// --- Resize Debouncing ---
+// The size callback only records the window size; the scene targets are rebuilt once it has been
+// stable for RESIZE_SETTLE_SECONDS, so dragging a window edge doesn't reallocate on every event.
+// Until then the old-size image is stretched to the window.
+const double RESIZE_SETTLE_SECONDS = 0.2;
+int windowWidth = 0, windowHeight = 0;
+double lastResizeTime = -1.0; // < 0: no resize pending
+
+// --- Sun Occlusion ---
+// Two queries ping-pong so each frame reads the previous frame's result and never stalls
+struct SunOcclusionQuery {
+    unsigned int queries[2] = {0, 0};
+    bool issued[2] = {false, false};
+    int current = 0;
+    bool occluded = false;
+
+    void init() { glGenQueries(2, queries); }
+
+    void destroy() {
+        glDeleteQueries(2, queries);
+        queries[0] = queries[1] = 0;
+    }
+
+    // Picks up last frame's answer (if the GPU has it yet) and opens this frame's query
+    void begin() {
+        int previous = current ^ 1;
+        if (issued[previous]) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint anyPassed = 0;
+                glGetQueryObjectuiv(queries[previous], GL_QUERY_RESULT, &anyPassed);
+                occluded = anyPassed == 0;
+                issued[previous] = false;
+            }
+        }
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, queries[current]);
+    }
+
+    void end() {
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        issued[current] = true;
+        current ^= 1;
+    }
+};
+SunOcclusionQuery sunOcclusion;
 
 // --- Minimap FBO ---
-unsigned int fboMinimap, texMinimap;
+unsigned int fboMinimap = 0, texMinimap;
 const int MINIMAP_WIDTH = 400;
 const int MINIMAP_HEIGHT = 400;
 
@@ -450,20 +3184,12 @@ void setupScreenQuad() {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 }
 
-// --- Create/Recreate all FBOs and Textures ---
+// --- Create/Recreate the screen-sized scene targets (the post chain's targets come from the pool) ---
 void createFramebuffers(int width, int height) {
     glDeleteFramebuffers(1, &fboScene);
     glDeleteTextures(1, &texSceneColor);
     glDeleteTextures(1, &texBrightMap);
-    glDeleteRenderbuffers(1, &rboDepth);
-    glDeleteFramebuffers(2, fboBloom);
-    glDeleteTextures(2, texBloom);
-    glDeleteFramebuffers(1, &fboGodRays);
-    glDeleteTextures(1, &texGodRays);
-    glDeleteFramebuffers(1, &fboComposite);
-    glDeleteTextures(1, &texComposite);
-    glDeleteFramebuffers(1, &fboFinal);
-    glDeleteTextures(1, &texFinal);
+    glDeleteTextures(1, &texSceneDepth);
 
     // --- FBO Pass 1 (Scene) ---
     glGenFramebuffers(1, &fboScene);
@@ -490,76 +3216,25 @@ void createFramebuffers(int width, int height) {
     unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, attachments);
 
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cerr << "ERROR::FRAMEBUFFER:: fboScene is not complete!" << endl;
-
-    // --- FBO Pass 2 (Bloom) ---
-    glGenFramebuffers(2, fboBloom);
-    glGenTextures(2, texBloom);
-    for (int i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, fboBloom[i]);
-        glBindTexture(GL_TEXTURE_2D, texBloom[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texBloom[i], 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            cerr << "ERROR::FRAMEBUFFER:: fboBloom[" << i << "] is not complete!" << endl;
-    }
-
-    // --- FBO Pass 3 (God Rays) ---
-    glGenFramebuffers(1, &fboGodRays);
-    glGenTextures(1, &texGodRays);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboGodRays);
-    glBindTexture(GL_TEXTURE_2D, texGodRays);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenTextures(1, &texSceneDepth);
+    glBindTexture(GL_TEXTURE_2D, texSceneDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texGodRays, 0);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cerr << "ERROR::FRAMEBUFFER:: fboGodRays is not complete!" << endl;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, texSceneDepth, 0);
 
-    // --- FBO Pass 4 (Composite) ---
-    glGenFramebuffers(1, &fboComposite);
-    glGenTextures(1, &texComposite);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboComposite);
-    glBindTexture(GL_TEXTURE_2D, texComposite);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texComposite, 0);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cerr << "ERROR::FRAMEBUFFER:: fboComposite is not complete!" << endl;
-
-    // --- FBO Pass 5 (Final) ---
-    // We create it just to avoid delete errors, but it won't be used for rendering
-    glGenFramebuffers(1, &fboFinal);
-    glGenTextures(1, &texFinal);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboFinal);
-    glBindTexture(GL_TEXTURE_2D, texFinal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texFinal, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cerr << "ERROR::FRAMEBUFFER:: fboFinal is not complete!" << endl;
+        cerr << "ERROR::FRAMEBUFFER:: fboScene is not complete!" << endl;
 
-    // --- Minimap FBO ---
-    glDeleteFramebuffers(1, &fboMinimap);
-    glDeleteTextures(1, &texMinimap);
+    sceneTargetBytes = (size_t)width * height * (8 + 8 + 4); // Two RGBA16F colours + D24S8
+
+    // --- Minimap FBO (fixed size, created once) ---
+    if (fboMinimap != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return;
+    }
     glGenFramebuffers(1, &fboMinimap);
     glBindFramebuffer(GL_FRAMEBUFFER, fboMinimap);
     glGenTextures(1, &texMinimap);
@@ -580,9 +3255,9 @@ void createFramebuffers(int width, int height) {
 // --- GLFW Callbacks ---
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     if (width > 0 && height > 0) {
-        SCR_WIDTH = width;
-        SCR_HEIGHT = height;
-        createFramebuffers(width, height); // Recreate FBOs to match window size
+        windowWidth = width;
+        windowHeight = height;
+        lastResizeTime = glfwGetTime(); // Targets follow once the size settles (see the render loop)
     }
 }
 
@@ -653,9 +3328,13 @@ void removeMoonsOfPlanet(int planetIndex) {
         if (it->parentPlanet == planetIndex) it = moons.erase(it);
         else ++it;
     }
+    ephemeris.setMoons(FIRST_MOON_BODY, moons);
+    simulation.setMoons(moons);
+    updateMoonOrbitBody();
 }
 
 void processInput(GLFWwindow *window) {
+    CpuZone zone("processInput");
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -685,6 +3364,17 @@ void processInput(GLFWwindow *window) {
         minusKeyPressed = false;
     }
 
+    // I toggles between the instanced asteroid belts and the per-rock draw loops
+    static bool instancingKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !instancingKeyPressed) {
+        useInstancedAsteroids = !useInstancedAsteroids;
+        cout << "Asteroid belts: " << (useInstancedAsteroids ? "instanced (1 draw call)" : "per-rock draw calls") << endl;
+        instancingKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE) {
+        instancingKeyPressed = false;
+    }
+
     if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS) focusedPlanet = 0;
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) focusedPlanet = 1;
     if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) focusedPlanet = 2;
@@ -806,11 +3496,15 @@ const char *litVertexShaderSource = R"glsl(
     out vec3 Normal;
     out vec3 FragPos;
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
     void main() {
         FragPos = vec3(model * vec4(aPos, 1.0));
-        Normal = mat3(transpose(inverse(model))) * aNormal;
+        Normal = mat3(model) * aNormal; // Lit bodies are rotated and uniformly scaled only; FS normalizes
         TexCoords = aTexCoords;
         gl_Position = projection * view * vec4(FragPos, 1.0);
     }
@@ -822,19 +3516,29 @@ const char *litFragmentShaderSource = R"glsl(
     in vec2 TexCoords;
     in vec3 Normal;
     in vec3 FragPos;
-    uniform sampler2D mainTexture;
-    uniform vec3 lightPos;
-    uniform vec3 viewPos;
+    uniform sampler2DArray bodyTextures;
+    uniform vec4 bodyLayer; // TextureStreamer::layerBinding(): xy UV scale, z layer
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
     uniform float ambientStrength;
     uniform bool hasTransparency;
     uniform float opacity;
+    // Wraps inside the layer's own UV range; gradients of the unwrapped UVs keep the mip level
+    // steady across the wrap, so there is no seam at u = 1
+    vec4 sampleBody(vec2 uv, vec4 layer) {
+        return textureGrad(bodyTextures, vec3(fract(uv) * layer.xy, layer.z), dFdx(uv) * layer.xy, dFdy(uv) * layer.xy);
+    }
     void main() {
         vec3 ambient = ambientStrength * vec3(1.0);
         vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
         float diff = max(dot(norm, lightDir), 0.0);
         vec3 diffuse = diff * vec3(1.0);
-        vec4 texColor = texture(mainTexture, TexCoords);
+        vec4 texColor = sampleBody(TexCoords, bodyLayer);
         vec3 result = (ambient + diffuse) * texColor.rgb;
         float finalOpacity = texColor.a * opacity;
         if (hasTransparency) {
@@ -845,14 +3549,72 @@ const char *litFragmentShaderSource = R"glsl(
     }
 )glsl";
 
+// Instanced variant of the lit vertex shader: the model matrix comes from a per-instance attribute
+const char *asteroidVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec3 aNormal;
+    layout (location = 2) in vec2 aTexCoords;
+    layout (location = 3) in mat4 aInstanceModel;
+    out vec2 TexCoords;
+    out vec3 Normal;
+    out vec3 FragPos;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
+    void main() {
+        FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+        Normal = mat3(aInstanceModel) * aNormal; // Rocks are uniformly scaled, no normal matrix needed
+        TexCoords = aTexCoords;
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+)glsl";
+
+// GPU-animated belt: each instance carries its orbit (radius, angle, size, height) and the
+// shader rotates it about the Sun by u_orbitAngle, matching rotate(Y) * translate * scale on the CPU
+const char *beltVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec3 aNormal;
+    layout (location = 2) in vec2 aTexCoords;
+    layout (location = 3) in vec4 aOrbit; // x = orbitRadius, y = angle (deg), z = size, w = yOffset
+    out vec2 TexCoords;
+    out vec3 Normal;
+    out vec3 FragPos;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
+    uniform float u_orbitAngle; // degrees
+    void main() {
+        float theta = radians(u_orbitAngle + aOrbit.y);
+        float c = cos(theta);
+        float s = sin(theta);
+        mat3 rotY = mat3(c, 0.0, -s,  0.0, 1.0, 0.0,  s, 0.0, c);
+        FragPos = rotY * (vec3(aOrbit.x, aOrbit.w, 0.0) + aPos * aOrbit.z);
+        Normal = rotY * aNormal;
+        TexCoords = aTexCoords;
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+)glsl";
+
 const char *skyboxVertexShaderSource = R"glsl(
     #version 330 core
     layout (location = 0) in vec3 aPos;
     layout (location = 2) in vec2 aTexCoords;
     out vec2 TexCoords;
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
     void main() {
         TexCoords = aTexCoords;
         gl_Position = projection * view * model * vec4(aPos, 1.0);
@@ -888,13 +3650,15 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
-out vec3 FragPos; 
-out vec3 Normal;
 out vec3 v_ModelPos; // <-- NEW: Pass model-space position
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPos;
+};
 
 uniform float u_time;
 uniform float u_displacementStrength;
@@ -910,9 +3674,7 @@ float simpleNoise(vec3 p) {
 void main()
 {
     TexCoords = aTexCoords;
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    v_ModelPos = aPos;
+    v_ModelPos = aPos; // The sun is unlit, so no world-space position or normal is needed
 
     vec3 noisePos = aPos * u_noiseScale + (aNormal * u_time * 0.5);
     float noise = simpleNoise(noisePos);
@@ -1000,9 +3762,13 @@ const char *orbitVertexShaderSource = R"glsl(
     #version 330 core
     layout (location = 0) in vec3 aPos;
     
-    uniform mat4 projection;
-    uniform mat4 view;
     uniform mat4 model;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
     
     void main() {
         gl_Position = projection * view * model * vec4(aPos, 1.0);
@@ -1034,44 +3800,89 @@ const char *postProcessVertexSource = R"glsl(
     }
 )glsl";
 
-// Gaussian Blur
-const char *gaussianBlurFragmentSource = R"glsl(
+// Bloom downsample: 13-tap filter (Jimenez, "Next Generation Post Processing in Call of Duty")
+const char *bloomDownsampleFragmentSource = R"glsl(
 #version 450 core
 out vec4 FragColor;
 in vec2 TexCoords;
-uniform sampler2D u_image;
-uniform bool u_horizontal;
+uniform sampler2D u_source;
+uniform bool u_karisAverage; // First level only: stops single bright texels (the Sun) from flickering
 
-// Fixed 5-tap weights from your code
-float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+float luma(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+// Weight a 2x2 block average by 1 / (1 + luma) so outliers can't dominate
+vec3 karisBlock(vec3 a, vec3 b, vec3 c, vec3 d, float weight, inout float total)
+{
+    vec3 avg = (a + b + c + d) * 0.25;
+    float w = weight / (1.0 + luma(avg));
+    total += w;
+    return avg * w;
+}
 
 void main()
 {
-    vec2 tex_offset = 1.0 / textureSize(u_image, 0);
-    vec3 result = texture(u_image, TexCoords).rgb * weights[0]; // Center sample
-    
-    if(u_horizontal)
-    {
-        for(int i = 1; i < 5; ++i)
-        {
-            result += texture(u_image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weights[i];
-            result += texture(u_image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weights[i];
-        }
-    }
-    else // Vertical
-    {
-        for(int i = 1; i < 5; ++i)
-        {
-            result += texture(u_image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weights[i];
-            result += texture(u_image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weights[i];
-        }
+    vec2 t = 1.0 / vec2(textureSize(u_source, 0));
+
+    vec3 a = texture(u_source, TexCoords + t * vec2(-2.0,  2.0)).rgb;
+    vec3 b = texture(u_source, TexCoords + t * vec2( 0.0,  2.0)).rgb;
+    vec3 c = texture(u_source, TexCoords + t * vec2( 2.0,  2.0)).rgb;
+    vec3 d = texture(u_source, TexCoords + t * vec2(-2.0,  0.0)).rgb;
+    vec3 e = texture(u_source, TexCoords).rgb;
+    vec3 f = texture(u_source, TexCoords + t * vec2( 2.0,  0.0)).rgb;
+    vec3 g = texture(u_source, TexCoords + t * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(u_source, TexCoords + t * vec2( 0.0, -2.0)).rgb;
+    vec3 i = texture(u_source, TexCoords + t * vec2( 2.0, -2.0)).rgb;
+    vec3 j = texture(u_source, TexCoords + t * vec2(-1.0,  1.0)).rgb;
+    vec3 k = texture(u_source, TexCoords + t * vec2( 1.0,  1.0)).rgb;
+    vec3 l = texture(u_source, TexCoords + t * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(u_source, TexCoords + t * vec2( 1.0, -1.0)).rgb;
+
+    vec3 result;
+    if (u_karisAverage) {
+        float total = 0.0;
+        result  = karisBlock(j, k, l, m, 0.5, total);
+        result += karisBlock(a, b, d, e, 0.125, total);
+        result += karisBlock(b, c, e, f, 0.125, total);
+        result += karisBlock(d, e, g, h, 0.125, total);
+        result += karisBlock(e, f, h, i, 0.125, total);
+        result /= total;
+    } else {
+        result  = e * 0.125;
+        result += (a + c + g + i) * 0.03125;
+        result += (b + d + f + h) * 0.0625;
+        result += (j + k + l + m) * 0.125;
     }
-    
-    FragColor = vec4(result, 1.0);
+    FragColor = vec4(max(result, vec3(0.0)), 1.0);
+}
+)glsl";
+
+// Bloom upsample: 3x3 tent filter, blended additively onto the next larger level
+const char *bloomUpsampleFragmentSource = R"glsl(
+#version 450 core
+out vec4 FragColor;
+in vec2 TexCoords;
+uniform sampler2D u_source;
+uniform float u_filterRadius = 1.0; // In source texels
+
+void main()
+{
+    vec2 r = u_filterRadius / vec2(textureSize(u_source, 0));
+
+    vec3 result = texture(u_source, TexCoords).rgb * 4.0;
+    result += texture(u_source, TexCoords + vec2(-r.x, 0.0)).rgb * 2.0;
+    result += texture(u_source, TexCoords + vec2( r.x, 0.0)).rgb * 2.0;
+    result += texture(u_source, TexCoords + vec2(0.0, -r.y)).rgb * 2.0;
+    result += texture(u_source, TexCoords + vec2(0.0,  r.y)).rgb * 2.0;
+    result += texture(u_source, TexCoords + vec2(-r.x, -r.y)).rgb;
+    result += texture(u_source, TexCoords + vec2( r.x, -r.y)).rgb;
+    result += texture(u_source, TexCoords + vec2(-r.x,  r.y)).rgb;
+    result += texture(u_source, TexCoords + vec2( r.x,  r.y)).rgb;
+
+    FragColor = vec4(result / 16.0, 1.0);
 }
 )glsl";
 
-// God Rays (Shortened)
+// God Rays (Shortened), rendered at reduced resolution
 const char *godRayFragmentSource = R"glsl(
 #version 450 core
 out vec4 FragColor;
@@ -1079,29 +3890,33 @@ in vec2 TexCoords;
 
 uniform sampler2D u_brightTexture; // texBrightMap
 uniform vec2 u_sunScreenPos;       // Sun's (0-1) screen position
+uniform int u_numSamples = 48;
 
 uniform float u_exposure = 0.8;
 uniform float u_decay = 0.95;
 uniform float u_density = 0.3; 
 uniform float u_weight = 0.1;
-const int NUM_SAMPLES = 100;
 
 void main()
 {
     vec2 delta = TexCoords - u_sunScreenPos;
-    vec2 step = delta / float(NUM_SAMPLES) * u_density;
+    vec2 step = delta / float(u_numSamples) * u_density;
+
+    // Keep the decay over the full ray length independent of the sample count
+    float decay = pow(u_decay, 100.0 / float(u_numSamples));
+    float weight = u_weight * 100.0 / float(u_numSamples);
 
     vec3 color = vec3(0.0);
     float illuminationDecay = 1.0;
 
-    for(int i=0; i < NUM_SAMPLES; i++)
+    for(int i=0; i < u_numSamples; i++)
     {
         vec2 sampleCoords = TexCoords - step * float(i);
         vec3 sampleColor = texture(u_brightTexture, sampleCoords).rgb;
         
-        sampleColor *= illuminationDecay * u_weight;
+        sampleColor *= illuminationDecay * weight;
         color += sampleColor;
-        illuminationDecay *= u_decay;
+        illuminationDecay *= decay;
     }
     
     FragColor = vec4(color * u_exposure, 1.0);
@@ -1114,120 +3929,1016 @@ const char *compositeFragmentSource = R"glsl(
     out vec4 FragColor;
     in vec2 TexCoords;
 
-    uniform sampler2D texSceneColor; // Pass 1
-    uniform sampler2D texBloom;      // Pass 2
-    uniform sampler2D texGodRays;    // Pass 3
+    uniform sampler2D texSceneColor; // Pass 1
+    uniform sampler2D texBloom;      // Pass 2
+    uniform sampler2D texGodRays;    // Pass 3 (reduced resolution)
+    uniform sampler2D texSceneDepth;
+    uniform float u_bloomStrength;   // Normalises the summed mip levels
+    uniform bool u_godRaysEnabled;
+    uniform vec2 u_nearFar;
+
+    float linearDepth(float d)
+    {
+        float z = d * 2.0 - 1.0;
+        return 2.0 * u_nearFar.x * u_nearFar.y / (u_nearFar.y + u_nearFar.x - z * (u_nearFar.y - u_nearFar.x));
+    }
+
+    // Joint bilateral upsample: bilinear weights for the four nearest low-res texels,
+    // scaled down where the depth at a texel's centre differs from this pixel's depth
+    vec3 upsampleGodRays()
+    {
+        vec2 lowSize = vec2(textureSize(texGodRays, 0));
+        vec2 coord = TexCoords * lowSize - 0.5;
+        vec2 base = floor(coord);
+        vec2 f = coord - base;
+        float depth = linearDepth(texture(texSceneDepth, TexCoords).r);
+
+        vec3 sum = vec3(0.0);
+        float weightSum = 0.0;
+        for (int i = 0; i < 4; i++) {
+            vec2 offset = vec2(i & 1, i >> 1);
+            vec2 uv = (base + offset + 0.5) / lowSize;
+            vec2 bilinear = mix(1.0 - f, f, offset);
+            float texelDepth = linearDepth(texture(texSceneDepth, uv).r);
+            float w = bilinear.x * bilinear.y / (0.001 + abs(texelDepth - depth) / depth);
+            sum += texture(texGodRays, uv).rgb * w;
+            weightSum += w;
+        }
+        return sum / max(weightSum, 1e-5);
+    }
+
+    void main()
+    {
+        vec3 sceneColor = texture(texSceneColor, TexCoords).rgb;
+        vec3 bloomColor = texture(texBloom, TexCoords).rgb * u_bloomStrength;
+        vec3 godRayColor = u_godRaysEnabled ? upsampleGodRays() : vec3(0.0);
+
+        // Additive Blending
+        vec3 finalColor = sceneColor + bloomColor + godRayColor;
+        
+        // Basic Tone Mapping
+        finalColor = finalColor / (finalColor + vec3(1.0));
+        finalColor = pow(finalColor, vec3(1.0/2.2)); // Gamma correction
+
+        FragColor = vec4(finalColor, 1.0);
+    }
+)glsl";
+
+// Heat Distortion (Declared but not used)
+const char *heatDistortionFragmentSource = R"glsl(
+#version 450 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D u_finalSceneTexture; // texComposite
+uniform sampler2D u_noiseTexture;      // e.g., earth clouds
+uniform float u_time;
+uniform float u_distortionStrength = 0.01; 
+
+void main()
+{
+    vec2 uv1 = TexCoords + vec2(u_time * 0.01, u_time * 0.02);
+    vec2 uv2 = TexCoords - vec2(u_time * 0.015, u_time * 0.005);
+
+    float noise1 = texture(u_noiseTexture, uv1).r;
+    float noise2 = texture(u_noiseTexture, uv2).g; 
+    
+    float offset = (noise1 + noise2 - 1.0) * u_distortionStrength;
+    vec2 distortedUVs = TexCoords + vec2(offset, offset);
+    
+    FragColor = texture(u_finalSceneTexture, distortedUVs);
+}
+)glsl";
+
+// Final Screen Shader
+const char *finalScreenFragmentSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+    in vec2 TexCoords;
+    uniform sampler2D texFinal; // This shader will read from texComposite
+    void main() {
+        FragColor = texture(texFinal, TexCoords);
+    }
+)glsl";
+
+// --- Compute Post Chain ---
+// Bloom prefilter: full-resolution bright map -> quarter resolution. Four bilinear taps cover each
+// 4x4 source block and are Karis-weighted so the Sun's hottest texels don't flicker.
+const char *bloomPrefilterComputeSource = R"glsl(
+#version 450 core
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(r11f_g11f_b10f, binding = 0) writeonly uniform image2D u_output;
+uniform sampler2D u_source;
+
+float luma(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(u_output);
+    if (any(greaterThanEqual(p, size))) return;
+
+    vec2 texel = 1.0 / vec2(textureSize(u_source, 0));
+    vec2 center = (vec2(p) + 0.5) / vec2(size);
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 offset = vec2((i & 1) == 0 ? -1.0 : 1.0, (i & 2) == 0 ? -1.0 : 1.0);
+        vec3 c = texture(u_source, center + offset * texel).rgb;
+        float w = 1.0 / (1.0 + luma(c));
+        sum += c * w;
+        weightSum += w;
+    }
+    imageStore(u_output, p, vec4(sum / weightSum, 1.0));
+}
+)glsl";
+
+// Tiled Gaussian blur (sigma 4, radius 8): each 16x16 group loads its tile plus apron into shared
+// memory once, blurs rows, then columns, so every source texel is fetched ~4 times instead of 34
+const char *bloomBlurComputeSource = R"glsl(
+#version 450 core
+#define TILE 16
+#define RADIUS 8
+#define APRON (TILE + 2 * RADIUS)
+layout(local_size_x = TILE, local_size_y = TILE) in;
+layout(r11f_g11f_b10f, binding = 0) writeonly uniform image2D u_output;
+uniform sampler2D u_source;
+
+shared vec3 tile[APRON][APRON];
+shared vec3 rows[APRON][TILE]; // Horizontally blurred, still including the vertical apron
+
+const float weights[RADIUS + 1] = float[](0.103153, 0.099979, 0.091032, 0.077864, 0.062565,
+                                          0.047227, 0.033489, 0.022308, 0.013960);
+
+void main()
+{
+    ivec2 size = textureSize(u_source, 0);
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - RADIUS;
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+    for (int y = local.y; y < APRON; y += TILE)
+        for (int x = local.x; x < APRON; x += TILE)
+            tile[y][x] = texelFetch(u_source, clamp(origin + ivec2(x, y), ivec2(0), size - 1), 0).rgb;
+    barrier();
+
+    for (int y = local.y; y < APRON; y += TILE) {
+        vec3 sum = tile[y][local.x + RADIUS] * weights[0];
+        for (int i = 1; i <= RADIUS; i++)
+            sum += (tile[y][local.x + RADIUS - i] + tile[y][local.x + RADIUS + i]) * weights[i];
+        rows[y][local.x] = sum;
+    }
+    barrier();
+
+    vec3 sum = rows[local.y + RADIUS][local.x] * weights[0];
+    for (int i = 1; i <= RADIUS; i++)
+        sum += (rows[local.y + RADIUS - i][local.x] + rows[local.y + RADIUS + i][local.x]) * weights[i];
+
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (all(lessThan(p, size))) imageStore(u_output, p, vec4(sum, 1.0));
+}
+)glsl";
+
+// Fused composite: scene + bloom + upsampled god rays, tone map and gamma, written straight to texFinal
+const char *fusedCompositeComputeSource = R"glsl(
+#version 450 core
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(rgba8, binding = 0) writeonly uniform image2D u_output;
+uniform sampler2D texSceneColor;
+uniform sampler2D texBloom;
+uniform sampler2D texGodRays;
+uniform sampler2D texSceneDepth;
+uniform float u_bloomStrength;
+uniform bool u_godRaysEnabled;
+uniform vec2 u_nearFar;
+
+float linearDepth(float d)
+{
+    float z = d * 2.0 - 1.0;
+    return 2.0 * u_nearFar.x * u_nearFar.y / (u_nearFar.y + u_nearFar.x - z * (u_nearFar.y - u_nearFar.x));
+}
+
+// Same joint bilateral upsample as the fragment composite
+vec3 upsampleGodRays(vec2 uvFull)
+{
+    vec2 lowSize = vec2(textureSize(texGodRays, 0));
+    vec2 coord = uvFull * lowSize - 0.5;
+    vec2 base = floor(coord);
+    vec2 f = coord - base;
+    float depth = linearDepth(texture(texSceneDepth, uvFull).r);
+
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 uv = (base + offset + 0.5) / lowSize;
+        vec2 bilinear = mix(1.0 - f, f, offset);
+        float texelDepth = linearDepth(texture(texSceneDepth, uv).r);
+        float w = bilinear.x * bilinear.y / (0.001 + abs(texelDepth - depth) / depth);
+        sum += texture(texGodRays, uv).rgb * w;
+        weightSum += w;
+    }
+    return sum / max(weightSum, 1e-5);
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(u_output);
+    if (any(greaterThanEqual(p, size))) return;
+    vec2 uv = (vec2(p) + 0.5) / vec2(size);
+
+    vec3 color = texelFetch(texSceneColor, p, 0).rgb;
+    color += texture(texBloom, uv).rgb * u_bloomStrength;
+    if (u_godRaysEnabled) color += upsampleGodRays(uv);
+
+    color = color / (color + vec3(1.0));
+    color = pow(color, vec3(1.0/2.2));
+    imageStore(u_output, p, vec4(color, 1.0));
+}
+)glsl";
+
+// --- MARKER SHADER (Simple Colored Dot) ---
+const char *markerVertexSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    
+    uniform mat4 model;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
+    
+    void main() {
+        gl_Position = projection * view * model * vec4(aPos, 1.0);
+    }
+)glsl";
+
+const char *markerFragmentSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+    
+    uniform vec3 markerColor;
+    
+    void main() {
+        FragColor = vec4(markerColor, 1.0);
+    }
+)glsl";
+
+
+// --- MULTI-DRAW INDIRECT SHADER (lit bodies and markers, per-draw data from an SSBO) ---
+const char *indirectVertexShaderSource = R"glsl(
+    #version 430 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec3 aNormal;
+    layout (location = 2) in vec2 aTexCoords;
+    layout (location = 3) in uint aDrawIndex; // The command's baseInstance (divisor 1, one instance)
+    struct DrawData {
+        mat4 model;
+        vec4 color;
+        vec4 params; // x: opacity, y: transparent, z: marker
+        vec4 layer;  // xy: UV scale, z: bodyTextures layer
+    };
+    layout (std430, binding = 1) readonly buffer DrawBuffer {
+        DrawData draws[];
+    };
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
+    out vec2 TexCoords;
+    out vec3 Normal;
+    out vec3 FragPos;
+    flat out vec4 DrawColor;
+    flat out vec4 DrawParams;
+    flat out vec4 DrawLayer;
+    void main() {
+        DrawData d = draws[aDrawIndex];
+        FragPos = vec3(d.model * vec4(aPos, 1.0));
+        Normal = mat3(d.model) * aNormal; // Rotation + uniform scale only, as in the lit shader
+        TexCoords = aTexCoords;
+        DrawColor = d.color;
+        DrawParams = d.params;
+        DrawLayer = d.layer;
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+    }
+)glsl";
+
+const char *indirectFragmentShaderSource = R"glsl(
+    #version 430 core
+    out vec4 FragColor;
+    in vec2 TexCoords;
+    in vec3 Normal;
+    in vec3 FragPos;
+    flat in vec4 DrawColor;
+    flat in vec4 DrawParams;
+    flat in vec4 DrawLayer;
+    uniform sampler2DArray bodyTextures;
+    layout (std140) uniform FrameUniforms {
+        mat4 projection;
+        mat4 view;
+        vec4 viewPos;
+        vec4 lightPos;
+    };
+    uniform float ambientStrength;
+    vec4 sampleBody(vec2 uv, vec4 layer) { // As in the lit shader
+        return textureGrad(bodyTextures, vec3(fract(uv) * layer.xy, layer.z), dFdx(uv) * layer.xy, dFdy(uv) * layer.xy);
+    }
+    void main() {
+        if (DrawParams.z > 0.5) { // Marker
+            FragColor = vec4(DrawColor.rgb, 1.0);
+            return;
+        }
+        vec3 ambient = ambientStrength * vec3(1.0);
+        vec3 norm = normalize(Normal);
+        vec3 lightDir = normalize(lightPos.xyz - FragPos);
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = diff * vec3(1.0);
+        vec4 texColor = sampleBody(TexCoords, DrawLayer);
+        vec3 result = (ambient + diffuse) * texColor.rgb;
+        float finalOpacity = DrawParams.y > 0.5 ? texColor.a * DrawParams.x : 1.0;
+        FragColor = vec4(result, finalOpacity);
+    }
+)glsl";
+
+// --- GPU Pass Profiler ---
+// GL_TIME_ELAPSED queries around each render stage. Queries issued in frame N are read in frame
+// N + FRAME_LATENCY, by which time they have normally landed; if not, that frame's results are
+// dropped rather than waited for. Elapsed queries cannot nest, so begin() closes the open pass.
+// A pass named more than once per frame (planets drawn around the belt) is summed. Each pass is
+// also a CPU trace zone of the same name and a glStats pass.
+class GpuProfiler {
+public:
+    static const int FRAME_LATENCY = 4;
+    static const int HISTORY = 300; // Frames kept per pass for min/avg/p99
+
+    struct PassStats {
+        string name;
+        int samples;
+        float lastMs, minMs, avgMs, p99Ms;
+    };
+
+    unsigned int droppedFrames = 0;
+
+    void beginFrame() {
+        end();
+        current = (current + 1) % FRAME_LATENCY;
+        collect(frames[current]);
+    }
+
+    void begin(const char* pass) {
+        end();
+        cpuZones.next(pass);
+        glStats.beginPass(pass);
+        FrameQueries& f = frames[current];
+        if (f.used == f.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            f.queries.push_back(query);
+            f.passIds.push_back(0);
+        }
+        f.passIds[f.used] = passId(pass);
+        glBeginQuery(GL_TIME_ELAPSED, f.queries[f.used++]);
+        open = true;
+    }
+
+    void end() {
+        cpuZones.end();
+        glStats.endPass();
+        if (!open) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        open = false;
+    }
+
+    vector<PassStats> stats() const {
+        vector<PassStats> result;
+        for (size_t p = 0; p < names.size(); ++p) {
+            if (history[p].empty()) continue;
+            vector<float> sorted = history[p];
+            sort(sorted.begin(), sorted.end());
+            double sum = 0.0;
+            for (float ms : sorted) sum += ms;
+            size_t p99 = (size_t)ceil(0.99 * sorted.size()) - 1;
+            result.push_back({names[p], (int)sorted.size(), lastMs[p], sorted.front(), (float)(sum / sorted.size()), sorted[p99]});
+        }
+        return result;
+    }
+
+    bool writeCSV(const string& path) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cerr << "ERROR::PROFILER::CANNOT_OPEN " << path << endl;
+            return false;
+        }
+        fprintf(file, "pass,samples,last_ms,min_ms,avg_ms,p99_ms\n");
+        for (const PassStats& s : stats())
+            fprintf(file, "%s,%d,%.4f,%.4f,%.4f,%.4f\n", s.name.c_str(), s.samples, s.lastMs, s.minMs, s.avgMs, s.p99Ms);
+        fclose(file);
+        return true;
+    }
+
+    void shutdown() {
+        for (FrameQueries& f : frames) {
+            if (!f.queries.empty()) glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+            f.queries.clear();
+        }
+    }
+
+private:
+    struct FrameQueries {
+        vector<GLuint> queries;
+        vector<int> passIds;
+        size_t used = 0;
+    };
+
+    void collect(FrameQueries& f) {
+        if (f.used == 0) return;
+        // Queries complete in submission order, so the last one stands for the whole frame
+        GLint available = 0;
+        glGetQueryObjectiv(f.queries[f.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            droppedFrames++;
+            f.used = 0;
+            return;
+        }
+        vector<double> frameMs(names.size(), -1.0);
+        for (size_t i = 0; i < f.used; ++i) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &ns);
+            double& ms = frameMs[f.passIds[i]];
+            ms = max(ms, 0.0) + ns / 1e6;
+        }
+        for (size_t p = 0; p < names.size(); ++p) {
+            if (frameMs[p] < 0.0) continue;
+            lastMs[p] = (float)frameMs[p];
+            if ((int)history[p].size() < HISTORY) history[p].push_back(lastMs[p]);
+            else history[p][historyNext[p]] = lastMs[p];
+            historyNext[p] = (historyNext[p] + 1) % HISTORY;
+        }
+        f.used = 0;
+    }
+
+    int passId(const char* name) {
+        for (size_t p = 0; p < names.size(); ++p) {
+            if (names[p] == name) return (int)p;
+        }
+        names.push_back(name);
+        history.emplace_back();
+        historyNext.push_back(0);
+        lastMs.push_back(0.0f);
+        return (int)names.size() - 1;
+    }
+
+    FrameQueries frames[FRAME_LATENCY];
+    int current = 0;
+    bool open = false;
+    CpuZoneChain cpuZones; // Same pass names on the CPU timeline
+    vector<string> names;           // First-use order, i.e. render order
+    vector<vector<float>> history;  // Ring of per-frame ms per pass
+    vector<int> historyNext;
+    vector<float> lastMs;
+};
+GpuProfiler gpuProfiler;
+string profileCsvPath; // --profile-csv FILE, written on exit
+
+// --- Headless Rendering ---
+// A surfaceless EGL context (Mesa llvmpipe works without a GPU or display); the frame is
+// rendered through the normal pipeline into fboFinal instead of the default framebuffer.
+struct HeadlessOptions {
+    bool enabled = false;
+    int frames = 120;
+    string outputPath;   // PPM of the last frame, if set
+};
+HeadlessOptions headless;
+
+#ifdef SOLAR_WITH_EGL
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool create() {
+        // Prefer Mesa's surfaceless platform; fall back to the default display
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+        if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+        if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            cerr << "ERROR::EGL::INITIALIZE_FAILED" << endl;
+            return false;
+        }
+        const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+            cerr << "ERROR::EGL::NO_OPENGL_CONFIG" << endl;
+            return false;
+        }
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            cerr << "ERROR::EGL::CONTEXT_FAILED (needs OpenGL 4.5 core and EGL_KHR_surfaceless_context)" << endl;
+            return false;
+        }
+        cout << "Headless EGL " << major << "." << minor << endl;
+        return true;
+    }
+
+    void destroy() {
+        if (display == EGL_NO_DISPLAY) return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+};
+#endif
+
+// Read back the bound framebuffer's colour attachment 0 as a binary PPM (rows flipped to top-down)
+bool writeFramebufferPPM(const string& path, int width, int height) {
+    vector<unsigned char> pixels((size_t)width * height * 3);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "ERROR::PPM::CANNOT_OPEN " << path << endl;
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; --y) fwrite(&pixels[(size_t)y * width * 3], 1, (size_t)width * 3, file);
+    fclose(file);
+    return true;
+}
+
+// --- Frame Export ---
+// Offline rendering of a fixed simulation-time range. Each frame is read into a ring of pixel buffer
+// objects so glReadPixels returns at once; a slot is mapped only when it comes round again (its fence
+// long signalled) and the pixels go to writer threads (one PPM per frame) or an encoder's stdin.
+struct ExportOptions {
+    string pattern;          // printf pattern for per-frame PPM files, e.g. frames/frame_%05d.ppm
+    string pipeCommand;      // or: raw top-down RGBA frames piped to this command
+    double startTime = 0.0;  // g_simulationTime of frame 0
+    double step = 1.0 / 60.0;
+    bool enabled() const { return !pattern.empty() || !pipeCommand.empty(); }
+};
+ExportOptions exportOptions;
+
+// The pattern is handed to snprintf with the frame index as its only argument, so it must hold exactly
+// one %d (optionally zero-padded, e.g. %05d); any other '%' has to be an escaped %%
+bool validFramePattern(const string& pattern) {
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') ++i;
+        if (i == pattern.size() || pattern[i] != 'd') return false;
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+class FrameExporter {
+public:
+    static const int RING_SIZE = 3;
+    static const int MAX_QUEUED_FRAMES = 8; // Caps memory if the disk or encoder falls behind
+
+    bool begin(const ExportOptions& options, int w, int h) {
+        opts = options;
+        width = w;
+        height = h;
+        frameBytes = (size_t)w * h * 4;
+        if (!opts.pipeCommand.empty()) {
+            pipe = popen(opts.pipeCommand.c_str(), PIPE_WRITE_MODE);
+            if (!pipe) {
+                cerr << "ERROR::EXPORT::CANNOT_START " << opts.pipeCommand << endl;
+                return false;
+            }
+        }
+        glGenBuffers(RING_SIZE, pbo);
+        for (int i = 0; i < RING_SIZE; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+            fence[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        // The pipe must see frames in order, so it gets a single writer
+        int writerCount = pipe ? 1 : (int)min(4u, max(1u, thread::hardware_concurrency() - 1));
+        for (int i = 0; i < writerCount; ++i) writers.emplace_back(&FrameExporter::writerLoop, this);
+        return true;
+    }
+
+    // Queue an asynchronous read of the bound read framebuffer's colour attachment 0
+    void capture(int frameIndex) {
+        int slot = frameIndex % RING_SIZE;
+        if (fence[slot]) drainSlot(slot);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotFrame[slot] = frameIndex;
+    }
+
+    // Drain outstanding reads in frame order, then flush and stop the writers
+    void finish() {
+        for (int k = 0; k < RING_SIZE; ++k) {
+            int oldest = -1;
+            for (int i = 0; i < RING_SIZE; ++i) {
+                if (fence[i] && (oldest < 0 || slotFrame[i] < slotFrame[oldest])) oldest = i;
+            }
+            if (oldest >= 0) drainSlot(oldest);
+        }
+        {
+            lock_guard<mutex> lock(queueMutex);
+            closing = true;
+        }
+        queueNotEmpty.notify_all();
+        for (thread& t : writers) t.join();
+        writers.clear();
+        if (pipe) pclose(pipe);
+        pipe = NULL;
+        glDeleteBuffers(RING_SIZE, pbo);
+    }
+
+    void report(double seconds) const {
+        double fps = framesWritten / seconds;
+        cout << "Export: " << framesWritten << " frames at " << width << "x" << height << " in " << fixed << setprecision(2)
+             << seconds << " s = " << fps << " fps (" << fps * frameBytes / (1024.0 * 1024.0) << " MB/s of pixels)";
+        if (failed) cout << " -- some frames failed to write";
+        cout << endl;
+    }
+
+private:
+    struct Frame {
+        int index;
+        vector<unsigned char> rgba; // Bottom-up, as read
+    };
+
+#ifdef _WIN32
+    static constexpr const char* PIPE_WRITE_MODE = "wb";
+#else
+    static constexpr const char* PIPE_WRITE_MODE = "w";
+#endif
+
+    void drainSlot(int slot) {
+        CpuZone zone("Map readback");
+        while (glClientWaitSync(fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence[slot]);
+        fence[slot] = 0;
+
+        Frame frame;
+        frame.index = slotFrame[slot];
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueNotFull.wait(lock, [&] { return (int)queue.size() < MAX_QUEUED_FRAMES; });
+            if (!spareBuffers.empty()) {
+                frame.rgba.swap(spareBuffers.back());
+                spareBuffers.pop_back();
+            }
+        }
+        frame.rgba.resize(frameBytes);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+        void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+        if (mapped) memcpy(frame.rgba.data(), mapped, frameBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!mapped) {
+            failed = true;
+            return;
+        }
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queue.push_back(move(frame));
+        }
+        queueNotEmpty.notify_one();
+    }
+
+    void writerLoop() {
+        cpuTrace.nameThread("Export writer");
+        vector<unsigned char> row((size_t)width * 4);
+        for (;;) {
+            Frame frame;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueNotEmpty.wait(lock, [&] { return closing || !queue.empty(); });
+                if (queue.empty()) return;
+                frame = move(queue.front());
+                queue.pop_front();
+            }
+            queueNotFull.notify_one();
+            CpuZone zone("Write frame");
+            if (!writeFrame(frame, row)) failed = true;
+            else ++framesWritten;
+            lock_guard<mutex> lock(queueMutex);
+            spareBuffers.push_back(move(frame.rgba));
+        }
+    }
 
-    void main()
-    {
-        vec3 sceneColor = texture(texSceneColor, TexCoords).rgb;
-        vec3 bloomColor = texture(texBloom, TexCoords).rgb;
-        vec3 godRayColor = texture(texGodRays, TexCoords).rgb;
+    bool writeFrame(const Frame& frame, vector<unsigned char>& row) {
+        const size_t stride = (size_t)width * 4;
+        if (pipe) {
+            for (int y = height - 1; y >= 0; --y) {
+                if (fwrite(&frame.rgba[y * stride], 1, stride, pipe) != stride) return false;
+            }
+            return true;
+        }
+        char path[1024];
+        snprintf(path, sizeof(path), opts.pattern.c_str(), frame.index);
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            cerr << "ERROR::EXPORT::CANNOT_OPEN " << path << endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        for (int y = height - 1; y >= 0; --y) {
+            const unsigned char* src = &frame.rgba[y * stride];
+            for (int x = 0; x < width; ++x) memcpy(&row[x * 3], &src[x * 4], 3);
+            fwrite(row.data(), 1, (size_t)width * 3, file);
+        }
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
 
-        // Additive Blending
-        vec3 finalColor = sceneColor + bloomColor + godRayColor;
-        
-        // Basic Tone Mapping
-        finalColor = finalColor / (finalColor + vec3(1.0));
-        finalColor = pow(finalColor, vec3(1.0/2.2)); // Gamma correction
+    ExportOptions opts;
+    int width = 0, height = 0;
+    size_t frameBytes = 0;
+    unsigned int pbo[RING_SIZE];
+    GLsync fence[RING_SIZE];
+    int slotFrame[RING_SIZE];
+    FILE* pipe = NULL;
+
+    vector<thread> writers;
+    mutex queueMutex;
+    condition_variable queueNotEmpty, queueNotFull;
+    deque<Frame> queue;
+    vector<vector<unsigned char>> spareBuffers;
+    bool closing = false;
+    atomic<int> framesWritten{0};
+    atomic<bool> failed{false};
+};
 
-        FragColor = vec4(finalColor, 1.0);
-    }
-)glsl";
+// --- Benchmark ---
+// --bench FILE.json replays scripted camera scenarios offscreen and writes frame-time percentiles with
+// draw-call and triangle counts per scenario. Everything that varies between runs is pinned: the belt
+// seed, the simulation time of every frame and the camera path. Each frame ends with glFinish, so its
+// time covers CPU and GPU work. With --headless it runs on llvmpipe, e.g. as a CI regression gate.
+struct BenchScenario {
+    const char* name;
+    int planet;                          // focusedPlanet
+    int location;                        // Earth location flown to, or -1 for the orbit camera
+    float distance, yaw, pitch;          // Orbit camera at the first warm-up frame
+    float yawPerFrame, distancePerFrame; // Scripted motion
+    double startTime;                    // g_simulationTime at the first warm-up frame
+};
+const BenchScenario BENCH_SCENARIOS[] = {
+    { "sun_overview",        0, -1, 160.0f, 90.0f, 35.0f, 0.25f,  0.0f,  0.0 },
+    { "earth_location_zoom", 3,  0,   5.0f, 90.0f, 20.0f, 0.0f,   0.0f, 10.0 },
+    { "saturn_ring_closeup", 6, -1,  16.0f, 60.0f, 12.0f, 0.4f,  -0.02f, 20.0 },
+    { "outer_belt_flyby",    0, -1, 128.0f,  0.0f,  2.0f, 0.6f,   0.0f, 30.0 },
+};
+const int BENCH_SCENARIO_COUNT = sizeof(BENCH_SCENARIOS) / sizeof(BENCH_SCENARIOS[0]);
+const double BENCH_TIME_STEP = 1.0 / 60.0;
 
-// Heat Distortion (Declared but not used)
-const char *heatDistortionFragmentSource = R"glsl(
-#version 450 core
-out vec4 FragColor;
-in vec2 TexCoords;
+struct BenchOptions {
+    string outputPath;     // --bench FILE.json
+    int warmupFrames = 30; // --warmup N, per scenario
+    bool enabled() const { return !outputPath.empty(); }
+};
+BenchOptions benchOptions;
 
-uniform sampler2D u_finalSceneTexture; // texComposite
-uniform sampler2D u_noiseTexture;      // e.g., texNoise (earth clouds)
-uniform float u_time;
-uniform float u_distortionStrength = 0.01; 
+class BenchRecorder {
+public:
+    // Returns the total frame count: every scenario runs 'warmup' unmeasured frames, then 'measured'
+    int begin(int measured, int warmup) {
+        measuredFrames = measured;
+        warmupFrames = warmup;
+        results.assign(BENCH_SCENARIO_COUNT, Result());
+        return BENCH_SCENARIO_COUNT * (warmupFrames + measuredFrames);
+    }
 
-void main()
-{
-    vec2 uv1 = TexCoords + vec2(u_time * 0.01, u_time * 0.02);
-    vec2 uv2 = TexCoords - vec2(u_time * 0.015, u_time * 0.005);
+    const BenchScenario& scenario(int frameIndex) const { return BENCH_SCENARIOS[frameIndex / framesPerScenario()]; }
+    double simulationTime(int frameIndex) const {
+        return scenario(frameIndex).startTime + (frameIndex % framesPerScenario()) * BENCH_TIME_STEP;
+    }
 
-    float noise1 = texture(u_noiseTexture, uv1).r;
-    float noise2 = texture(u_noiseTexture, uv2).g; 
-    
-    float offset = (noise1 + noise2 - 1.0) * u_distortionStrength;
-    vec2 distortedUVs = TexCoords + vec2(offset, offset);
-    
-    FragColor = texture(u_finalSceneTexture, distortedUVs);
-}
-)glsl";
+    // Stands in for processInput(): drives the camera globals along the scenario's path
+    void applyCamera(int frameIndex) const {
+        const BenchScenario& s = scenario(frameIndex);
+        int local = frameIndex % framesPerScenario();
+        focusedPlanet = s.planet;
+        cameraDistance = s.distance + s.distancePerFrame * local;
+        cameraYaw = s.yaw + s.yawPerFrame * local;
+        cameraPitch = s.pitch;
+        focusedLocationIndex = s.location;
+        showEarthLocation = isMovingToLocation = s.location >= 0;
+        if (s.location >= 0) currentLocationIndex = s.location;
+        if (local == 0) currentCameraPos = glm::vec3(0.0f); // Every fly-to starts from the same place
+    }
 
-// Final Screen Shader
-const char *finalScreenFragmentSource = R"glsl(
-    #version 330 core
-    out vec4 FragColor;
-    in vec2 TexCoords;
-    uniform sampler2D texFinal; // This shader will read from texComposite
-    void main() {
-        FragColor = texture(texFinal, TexCoords);
+    void record(int frameIndex, double ms, const GLCallCounters& draws) {
+        if (frameIndex % framesPerScenario() < warmupFrames) return;
+        Result& r = results[frameIndex / framesPerScenario()];
+        r.frameMs.push_back(ms);
+        r.drawCalls += draws.drawCalls;
+        r.triangles += draws.triangles;
+        r.maxDrawCalls = max(r.maxDrawCalls, draws.drawCalls);
+        r.maxTriangles = max(r.maxTriangles, draws.triangles);
     }
-)glsl";
 
-// --- MARKER SHADER (Simple Colored Dot) ---
-const char *markerVertexSource = R"glsl(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-    
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-    
-    void main() {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
+    bool write(const string& path, int width, int height, unsigned int seed) {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cerr << "ERROR::BENCH::CANNOT_OPEN " << path << endl;
+            return false;
+        }
+        string renderer = (const char*)glGetString(GL_RENDERER);
+        for (char& c : renderer)
+            if (c == '"' || c == '\\') c = '\'';
+        fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"seed\": %u,\n",
+                renderer.c_str(), width, height, seed);
+        fprintf(file, "  \"warmup_frames\": %d,\n  \"measured_frames\": %d,\n  \"scenarios\": [\n", warmupFrames, measuredFrames);
+        for (int i = 0; i < BENCH_SCENARIO_COUNT; ++i) {
+            Result& r = results[i];
+            sort(r.frameMs.begin(), r.frameMs.end());
+            double sum = 0.0;
+            for (double ms : r.frameMs) sum += ms;
+            size_t n = max<size_t>(1, r.frameMs.size());
+            fprintf(file, "    {\n      \"name\": \"%s\",\n", BENCH_SCENARIOS[i].name);
+            fprintf(file, "      \"frame_ms\": { \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f },\n",
+                    percentile(r, 0.0), percentile(r, 0.50), percentile(r, 0.90), percentile(r, 0.95), percentile(r, 0.99),
+                    percentile(r, 1.0), sum / n);
+            fprintf(file, "      \"draw_calls\": { \"mean\": %.1f, \"max\": %u },\n", (double)r.drawCalls / n, r.maxDrawCalls);
+            fprintf(file, "      \"triangles\": { \"mean\": %.0f, \"max\": %llu }\n    }%s\n",
+                    (double)r.triangles / n, r.maxTriangles, i + 1 < BENCH_SCENARIO_COUNT ? "," : "");
+            cout << "Bench " << BENCH_SCENARIOS[i].name << ": p50 " << fixed << setprecision(2) << percentile(r, 0.50)
+                 << " ms, p99 " << percentile(r, 0.99) << " ms, " << r.maxDrawCalls << " draws, " << r.maxTriangles << " triangles" << endl;
+        }
+        fprintf(file, "  ]\n}\n");
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
     }
-)glsl";
 
-const char *markerFragmentSource = R"glsl(
-    #version 330 core
-    out vec4 FragColor;
-    
-    uniform vec3 markerColor;
-    
-    void main() {
-        FragColor = vec4(markerColor, 1.0);
+private:
+    struct Result {
+        vector<double> frameMs;
+        unsigned long long drawCalls = 0, triangles = 0; // Sums over measured frames
+        unsigned int maxDrawCalls = 0;
+        unsigned long long maxTriangles = 0;
+    };
+
+    int framesPerScenario() const { return warmupFrames + measuredFrames; }
+    // Nearest rank on the sorted samples
+    static double percentile(const Result& r, double p) {
+        if (r.frameMs.empty()) return 0.0;
+        size_t rank = (size_t)ceil(p * r.frameMs.size());
+        return r.frameMs[min(r.frameMs.size() - 1, rank > 0 ? rank - 1 : 0)];
     }
-)glsl";
 
+    int measuredFrames = 0, warmupFrames = 0;
+    vector<Result> results;
+};
 
 // --- Main ---
-int main() {
-    // --- 1. Initialize GLFW and GLAD ---
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Interactive Solar System - Post-Processing", NULL, NULL);
-    if (window == NULL) {
-        cerr << "Failed to create GLFW window" << endl;
-        glfwTerminate();
-        return -1;
+int main(int argc, char** argv) {
+    // --- 0. Command Line ---
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--asteroids" && i + 1 < argc) {
+            asteroidCount = max(1, atoi(argv[++i]));
+        } else if (arg == "--bench-kepler" && i + 1 < argc) {
+            return runKeplerBenchmark(atoi(argv[++i]));
+        } else if (arg == "--headless") {
+            headless.enabled = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            headless.frames = max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && i + 1 < argc) {
+            unsigned int w = 0, h = 0;
+            if (sscanf(argv[++i], "%ux%u", &w, &h) != 2 || w == 0 || h == 0) {
+                cerr << "Invalid --size (expected WIDTHxHEIGHT): " << argv[i] << endl;
+                return 1;
+            }
+            SCR_WIDTH = w;
+            SCR_HEIGHT = h;
+        } else if (arg == "--output" && i + 1 < argc) {
+            headless.outputPath = argv[++i];
+        } else if (arg == "--export" && i + 1 < argc) {
+            exportOptions.pattern = argv[++i];
+            if (!validFramePattern(exportOptions.pattern)) {
+                cerr << "Invalid --export (expected one %d or %0Nd for the frame number): " << argv[i] << endl;
+                return 1;
+            }
+        } else if (arg == "--export-pipe" && i + 1 < argc) {
+            exportOptions.pipeCommand = argv[++i];
+        } else if (arg == "--start" && i + 1 < argc) {
+            exportOptions.startTime = atof(argv[++i]);
+        } else if (arg == "--step" && i + 1 < argc) {
+            exportOptions.step = atof(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceCapturePath = argv[++i];
+        } else if (arg == "--bake-textures") { // Takes the rest of the command line
+            vector<string> files(argv + i + 1, argv + argc);
+            return bakeTextures(files);
+        } else if (arg == "--compute-post") {
+            useComputePost = true;
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchOptions.outputPath = argv[++i];
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            benchOptions.warmupFrames = max(0, atoi(argv[++i]));
+        } else if (arg == "--gl-stats" && i + 1 < argc) {
+            glStatsPath = argv[++i];
+        } else if (arg == "--profile-csv" && i + 1 < argc) {
+            profileCsvPath = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            randomSeed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            hasRandomSeed = true;
+        } else {
+            cerr << "Unknown argument: " << arg << endl;
+            cerr << "Usage: Solar [--asteroids N] [--bench-kepler N] [--size WxH] [--seed N]" << endl;
+            cerr << "             [--profile-csv FILE] [--gl-stats FILE.json] [--trace FILE.json] [--compute-post]" << endl;
+            cerr << "             [--bake-textures [IMAGE...]] [--bench results.json] [--warmup N]" << endl;
+            cerr << "             [--headless] [--frames N] [--output frame.ppm]" << endl;
+            cerr << "             [--export frames/%05d.ppm | --export-pipe \"encoder cmd\"] [--start T] [--step DT]" << endl;
+            return 1;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        cerr << "Failed to initialize GLAD" << endl;
-        return -1;
+    if (benchOptions.enabled() && exportOptions.enabled()) {
+        cerr << "--bench cannot be combined with --export/--export-pipe" << endl;
+        return 1;
     }
+    // Exports and benchmarks replay a fixed time range, so the random belt must be reproducible too
+    if ((exportOptions.enabled() || benchOptions.enabled()) && !hasRandomSeed) {
+        randomSeed = 1;
+        hasRandomSeed = true;
+    }
+    BenchRecorder bench;
+    if (benchOptions.enabled()) headless.frames = bench.begin(headless.frames, benchOptions.warmupFrames); // --frames is per scenario
+    const bool fixedFrameRun = headless.enabled || exportOptions.enabled() || benchOptions.enabled(); // No UI, exits after --frames
+    cpuTrace.nameThread("Main");
+    if (!traceCapturePath.empty()) cpuTrace.start(); // From here, so startup texture loads are included
+
+    // --- 1. Initialize GLFW (or a headless EGL context) and GLAD ---
+    GLFWwindow* window = NULL;
+#ifdef SOLAR_WITH_EGL
+    HeadlessContext headlessContext;
+#endif
+    if (headless.enabled) {
+#ifdef SOLAR_WITH_EGL
+        if (!headlessContext.create()) return -1;
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+            cerr << "Failed to initialize GLAD" << endl;
+            return -1;
+        }
+#else
+        cerr << "--headless needs a build with -DSOLAR_WITH_EGL (link -lEGL)" << endl;
+        return 1;
+#endif
+    } else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (fixedFrameRun) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // Context only; frames go to FBOs
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Interactive Solar System - Post-Processing", NULL, NULL);
+        if (window == NULL) {
+            cerr << "Failed to create GLFW window" << endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            cerr << "Failed to initialize GLAD" << endl;
+            return -1;
+        }
 
-    // --- Initialize ImGui ---
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330");
+        // --- Initialize ImGui ---
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui::StyleColorsDark();
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330");
+    }
 
 
     // --- 2. Configure OpenGL State ---
@@ -1236,92 +4947,145 @@ int main() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // --- 3. Build and Compile Shaders ---
-    Shader litShader(litVertexShaderSource, litFragmentShaderSource);
+    Shader litShader(litVertexShaderSource, litFragmentShaderSource); // Uniformly scaled spheres and the ring only
+    Shader asteroidShader(asteroidVertexShaderSource, litFragmentShaderSource);  // Instanced asteroid belt
+    Shader beltShader(beltVertexShaderSource, litFragmentShaderSource);          // GPU-animated Kuiper belt
     Shader skyboxShader(skyboxVertexShaderSource, skyboxFragmentShaderSource);
     Shader sunShader(sunVertexSource, sunFragmentSource);
     Shader orbitShader(orbitVertexShaderSource, orbitFragmentShaderSource);
-    Shader gaussianBlurShader(postProcessVertexSource, gaussianBlurFragmentSource);
+    Shader bloomDownsampleShader(postProcessVertexSource, bloomDownsampleFragmentSource);
+    Shader bloomUpsampleShader(postProcessVertexSource, bloomUpsampleFragmentSource);
     Shader godRayShader(postProcessVertexSource, godRayFragmentSource);
     Shader compositeShader(postProcessVertexSource, compositeFragmentSource);
     Shader heatDistortionShader(postProcessVertexSource, heatDistortionFragmentSource); // Compiled but not used
     Shader finalScreenShader(postProcessVertexSource, finalScreenFragmentSource);
+    Shader bloomPrefilterCompute(bloomPrefilterComputeSource);
+    Shader bloomBlurCompute(bloomBlurComputeSource);
+    Shader fusedCompositeCompute(fusedCompositeComputeSource);
     Shader markerShader(markerVertexSource, markerFragmentSource);  // For location markers
+    Shader indirectShader(indirectVertexShaderSource, indirectFragmentShaderSource); // Queued bodies and markers via MDI
 
 
     // --- 4. Load Textures ---
-    unsigned int sunTex = loadTexture("sun.bmp", false);
-    unsigned int mercuryTex = loadTexture("mercury.bmp", false); 
-    unsigned int venusTex = loadTexture("venus.bmp", false);
-    unsigned int venusAtmoTex = loadTexture("venus_atmosphere.bmp", true);
-    unsigned int earthDayTex = loadTexture("earth_daymap.bmp", false);
-    unsigned int earthCloudsTex = loadTexture("earth_clouds.bmp", true);
-    unsigned int moonTex = loadTexture("moon.bmp", false);
-    unsigned int marsTex = loadTexture("mars.bmp", false);
-    unsigned int jupiterTex = loadTexture("jupiter.bmp", false);
-    unsigned int saturnTex = loadTexture("saturn.bmp", false);
-    unsigned int saturnRingTex = loadTexture("saturn_ring_alpha.bmp", true);
-    unsigned int uranusTex = loadTexture("uranus.bmp", false);
-    unsigned int neptuneTex = loadTexture("neptune.bmp", false);
-    unsigned int skyTex = loadTexture("star_milky_way.jpg", false);
-    unsigned int asteroidTex = loadTexture("moon.bmp", false); 
-    
-    // Assign moon textures (using moon texture for all moons for now)
-    for (auto& moon : moons) {
-        moon.texture = moonTex;
-    }
-    
-    texNoise = earthCloudsTex; // Re-using clouds texture as a noise source
+    // Decoded on loader threads; each name is a placeholder until its upload completes (see TextureStreamer)
+    textures.start((int)min(4u, max(1u, thread::hardware_concurrency() - 1)));
+    const unsigned int& sunTex = textures.request("sun.bmp", false);
+    const unsigned int& skyTex = textures.request("star_milky_way.jpg", false);
+    // Every lit body (planets, moons, ring, asteroid rocks) samples one array; see TextureStreamer
+    const int mercuryLayer = textures.requestLayer("mercury.bmp", false);
+    const int venusLayer = textures.requestLayer("venus.bmp", false);
+    const int venusAtmoLayer = textures.requestLayer("venus_atmosphere.bmp", true);
+    const int earthDayLayer = textures.requestLayer("earth_daymap.bmp", false);
+    const int earthCloudsLayer = textures.requestLayer("earth_clouds.bmp", true);
+    const int moonLayer = textures.requestLayer("moon.bmp", false);
+    const int marsLayer = textures.requestLayer("mars.bmp", false);
+    const int jupiterLayer = textures.requestLayer("jupiter.bmp", false);
+    const int saturnLayer = textures.requestLayer("saturn.bmp", false);
+    const int saturnRingLayer = textures.requestLayer("saturn_ring_alpha.bmp", true);
+    const int uranusLayer = textures.requestLayer("uranus.bmp", false);
+    const int neptuneLayer = textures.requestLayer("neptune.bmp", false);
+    const int asteroidLayer = moonLayer; // Rocks reuse the Moon's surface
+    if (fixedFrameRun) textures.finishAll(); // Offscreen frames must never show placeholders
 
     // --- 5. Create Geometry ---
-    Sphere sphere(50, 50);
+    SphereLODSet sphereLODs({64, 32, 16, 8});
+    Sphere& skySphere = sphereLODs.levels[1]; // Seen from inside, the silhouette never shows
     Sphere lowPolySphere(10, 10); 
     createRing(6.0f, 9.0f, 50);
+    vector<GLuint> indirectMeshes = { lowPolySphere.VAO, ringVAO };
+    for (const Sphere& level : sphereLODs.levels) indirectMeshes.push_back(level.VAO);
+    indirectDraws.init(indirectMeshes);
     
-    // --- 5b. Create Orbits ---
-    for (int i = 0; i < 9; ++i) {
-        createEllipticalOrbit(i);
-    }
-
     // --- Setup Post-Processing ---
+    createFrameUniformBuffer();
     setupScreenQuad();
     createFramebuffers(SCR_WIDTH, SCR_HEIGHT); // Create initial FBOs
+    windowWidth = SCR_WIDTH;
+    windowHeight = SCR_HEIGHT;
+    sunOcclusion.init();
 
     // --- 6. Initialize Asteroid Belt ---
-    asteroidMatrices = new glm::mat4[ASTEROID_COUNT];
-    srand(static_cast<unsigned int>(time(0)));
-    for (int i = 0; i < ASTEROID_COUNT; ++i) {
-        Asteroid a;
-        a.orbitRadius = 40.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 5.0f));
-        a.angle = static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 360.0f));
-        a.size = 0.02f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 0.05f));
-        a.yOffset = -0.5f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 1.0f));
-        asteroidBelt.push_back(a);
+    asteroidMatrices = new glm::mat4[asteroidCount];
+    setupAsteroidInstancing(lowPolySphere, asteroidInstanceVBO, asteroidCount);
+    SmallBodyStore asteroidStore;
+    srand(hasRandomSeed ? randomSeed : static_cast<unsigned int>(time(0)));
+    generateAsteroidBelt(asteroidStore, asteroidCount);
+
+    // --- 6a. Initialize Kuiper Belt (once; fixed seed for a consistent outer belt) ---
+    {
+        CpuZone zone("Kuiper belt setup");
+        srand(12345);
+        for (int i = 0; i < KUIPER_COUNT; ++i) {
+            Asteroid a;
+            a.orbitRadius = 115.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 25.0f));
+            a.angle = static_cast<float>(rand() % 360);
+            a.yOffset = -1.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 2.0f));
+            a.size = 0.012f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 0.025f));
+            kuiperBelt.push_back(a);
+        }
+        kuiperSectors = buildBeltSectors(kuiperBelt, BELT_SECTOR_COUNT);
+        setupBeltVAO(lowPolySphere, kuiperBelt, kuiperVAO, kuiperInstanceVBO);
     }
     
     // --- 6b. Initialize Moons ---
     // Mars moons (1 moon)
-    moons.push_back({4, 2.0f, 15.0f, 0.2f, 0});  // Phobos
+    moons.push_back({4, 2.0f, 15.0f, 0.2f});  // Phobos
     
     // Jupiter moons (3 moons)
-    moons.push_back({5, 4.5f, 8.0f, 0.3f, 0});   // Io
-    moons.push_back({5, 6.0f, 5.0f, 0.35f, 0});  // Europa
-    moons.push_back({5, 8.0f, 3.0f, 0.25f, 0});  // Ganymede
+    moons.push_back({5, 4.5f, 8.0f, 0.3f});   // Io
+    moons.push_back({5, 6.0f, 5.0f, 0.35f});  // Europa
+    moons.push_back({5, 8.0f, 3.0f, 0.25f});  // Ganymede
     
     // Saturn moons (2 moons)
-    moons.push_back({6, 5.5f, 10.0f, 0.3f, 0});  // Titan
-    moons.push_back({6, 7.0f, 7.0f, 0.2f, 0});   // Enceladus
+    moons.push_back({6, 5.5f, 10.0f, 0.3f});  // Titan
+    moons.push_back({6, 7.0f, 7.0f, 0.2f});   // Enceladus
     
     // Earth Moon
-    moons.push_back({3, 2.5f, 13.0f, 0.4f, 0});  // Moon
+    moons.push_back({3, 2.5f, 13.0f, 0.4f, 0.0549f});  // Moon
+    
+    // --- Ephemeris (planets, then the moons above) ---
+    initializeEphemeris();
+    ephemeris.setMoons(FIRST_MOON_BODY, moons);
+    if ((int)planetPositions.size() < ephemeris.bodyCount()) planetPositions.resize(ephemeris.bodyCount());
+
+    // --- Simulation thread (inner belt and ephemeris); one tick up front so a snapshot exists ---
+    simulation.init(ephemeris, move(asteroidStore));
+    simulation.tick(simulation.now());
+    if (!fixedFrameRun) simulation.start(); // Offscreen runs step it directly, once per frame
+
+    FrameExporter exporter;
+    if (exportOptions.enabled() && !exporter.begin(exportOptions, SCR_WIDTH, SCR_HEIGHT)) return -1;
+    updateMoonOrbitBody();
+    
+    // --- Orbit lines (traced from the ephemeris, so after the moons exist) ---
+    for (int i = 0; i < 9; ++i) {
+        if (orbitParams[i].body < 0) continue;
+        createEllipticalOrbit(i);
+    }
     
     // --- 6c. Initialize Planet Data ---
     initializePlanetData();
 
     // --- 7. Set up Shader Uniforms (that don't change) ---
     litShader.use();
-    litShader.setInt("mainTexture", 0);
-    litShader.setVec3("lightPos", glm::vec3(0.0f));
+    litShader.setInt("bodyTextures", 0);
     litShader.setFloat("ambientStrength", 0.1f);
+
+    indirectShader.use();
+    indirectShader.setInt("bodyTextures", 0);
+    indirectShader.setFloat("ambientStrength", 0.1f);
+
+    asteroidShader.use();
+    asteroidShader.setInt("bodyTextures", 0);
+    asteroidShader.setFloat("ambientStrength", 0.1f);
+    asteroidShader.setBool("hasTransparency", false);
+    asteroidShader.setFloat("opacity", 1.0f);
+
+    beltShader.use();
+    beltShader.setInt("bodyTextures", 0);
+    beltShader.setFloat("ambientStrength", 0.1f);
+    beltShader.setBool("hasTransparency", false);
+    beltShader.setFloat("opacity", 1.0f);
     
     sunShader.use();
     sunShader.setInt("u_colorRamp", 0);
@@ -1331,12 +5095,34 @@ int main() {
 
     skyboxShader.use();
     skyboxShader.setInt("mainTexture", 0);
-    GLint skyTimeLoc = glGetUniformLocation(skyboxShader.ID, "time");
+
+    bloomDownsampleShader.use();
+    bloomDownsampleShader.setInt("u_source", 0);
+    bloomUpsampleShader.use();
+    bloomUpsampleShader.setInt("u_source", 0);
+
+    godRayShader.use();
+    godRayShader.setInt("u_brightTexture", 0);
 
     compositeShader.use();
     compositeShader.setInt("texSceneColor", 0);
     compositeShader.setInt("texBloom", 1);
     compositeShader.setInt("texGodRays", 2);
+    compositeShader.setInt("texSceneDepth", 3);
+    compositeShader.setFloat("u_bloomStrength", 1.0f / BLOOM_MIP_COUNT);
+    compositeShader.setVec2("u_nearFar", glm::vec2(CAMERA_NEAR, CAMERA_FAR));
+
+    bloomPrefilterCompute.use();
+    bloomPrefilterCompute.setInt("u_source", 0);
+    bloomBlurCompute.use();
+    bloomBlurCompute.setInt("u_source", 0);
+    fusedCompositeCompute.use();
+    fusedCompositeCompute.setInt("texSceneColor", 0);
+    fusedCompositeCompute.setInt("texBloom", 1);
+    fusedCompositeCompute.setInt("texGodRays", 2);
+    fusedCompositeCompute.setInt("texSceneDepth", 3);
+    fusedCompositeCompute.setFloat("u_bloomStrength", 1.0f);
+    fusedCompositeCompute.setVec2("u_nearFar", glm::vec2(CAMERA_NEAR, CAMERA_FAR));
 
     // Set uniforms for shaders we aren't using (or are, in finalScreenShader's case)
     heatDistortionShader.use();
@@ -1347,64 +5133,88 @@ int main() {
     finalScreenShader.use();
     finalScreenShader.setInt("texFinal", 0); // This will read from whatever texture we bind to unit 0
 
+    // --- 7b. Resolve per-frame uniform handles (the render loop does no name lookups) ---
+    auto skyboxModelLoc = skyboxShader.handle<glm::mat4>("model");
+    auto skyTimeLoc = skyboxShader.handle<float>("time");
+    auto sunTimeLoc = sunShader.handle<float>("u_time");
+    auto sunModelLoc = sunShader.handle<glm::mat4>("model");
+    auto litHasTransparencyLoc = litShader.handle<bool>("hasTransparency");
+    auto litOpacityLoc = litShader.handle<float>("opacity");
+    auto litModelLoc = litShader.handle<glm::mat4>("model");
+    auto litBodyLayerLoc = litShader.handle<glm::vec4>("bodyLayer");
+    auto asteroidBodyLayerLoc = asteroidShader.handle<glm::vec4>("bodyLayer");
+    auto beltBodyLayerLoc = beltShader.handle<glm::vec4>("bodyLayer");
+    auto markerModelLoc = markerShader.handle<glm::mat4>("model");
+    auto markerColorLoc = markerShader.handle<glm::vec3>("markerColor");
+    auto beltOrbitAngleLoc = beltShader.handle<float>("u_orbitAngle");
+    auto orbitModelLoc = orbitShader.handle<glm::mat4>("model");
+    auto orbitColorLoc = orbitShader.handle<glm::vec3>("orbitColor");
+    auto bloomKarisAverageLoc = bloomDownsampleShader.handle<bool>("u_karisAverage");
+    auto godRaySunScreenPosLoc = godRayShader.handle<glm::vec2>("u_sunScreenPos");
+    auto godRayNumSamplesLoc = godRayShader.handle<int>("u_numSamples");
+    auto compositeGodRaysEnabledLoc = compositeShader.handle<bool>("u_godRaysEnabled");
+    auto fusedGodRaysEnabledLoc = fusedCompositeCompute.handle<bool>("u_godRaysEnabled");
+
     // --- 8. Render Loop ---
-    float lastFrame = 0.0f;
-    float deltaTime = 0.0f;
-    while (!glfwWindowShouldClose(window)) {
+    int frameIndex = 0;
+    auto loopStart = chrono::steady_clock::now();
+    while (fixedFrameRun ? frameIndex < headless.frames : !glfwWindowShouldClose(window)) {
         // --- Per-frame Time ---
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        g_simulationTime += deltaTime * timeScale; 
-        float g_animationAngle = static_cast<float>(g_simulationTime * 20.0);
+        auto frameStart = chrono::steady_clock::now();
+        CpuZone frameZone("Frame");
+        CpuZoneChain frameSections; // CPU-only sections; render passes are zoned by gpuProfiler
+        Shader::s_uniformLookups = 0;
+        glStats.beginFrame();
+        gpuProfiler.beginFrame();
 
         // --- Input ---
-        processInput(window);
-
-        // --- Update all planet positions ---
-        // Sun always stays at center
-        planetPositions[0] = glm::vec3(0.0f, 0.0f, 0.0f); // Sun - ALWAYS at center
-        
-        // When a planet (not sun) is selected, keep sun at center and show the selected planet
-        if (focusedPlanet == 0) {
-            // Sun is focused - show all planets in their orbits around sun at center
-            planetPositions[1] = glm::vec3(cos(glm::radians(g_animationAngle * 4.15f)) * 12.0f, 0.0f, sin(glm::radians(g_animationAngle * 4.15f)) * 12.0f); // Mercury
-            planetPositions[2] = glm::vec3(cos(glm::radians(g_animationAngle * 1.62f)) * 16.0f, 0.0f, sin(glm::radians(g_animationAngle * 1.62f)) * 16.0f); // Venus
-            planetPositions[3] = glm::vec3(cos(glm::radians(g_animationAngle * 1.0f)) * 22.0f, 0.0f, sin(glm::radians(g_animationAngle * 1.0f)) * 22.0f); // Earth
-            planetPositions[4] = glm::vec3(cos(glm::radians(g_animationAngle * 0.53f)) * 30.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.53f)) * 30.0f); // Mars
-            planetPositions[5] = glm::vec3(cos(glm::radians(g_animationAngle * 0.08f)) * 50.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.08f)) * 50.0f); // Jupiter
-            planetPositions[6] = glm::vec3(cos(glm::radians(g_animationAngle * 0.03f)) * 70.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.03f)) * 70.0f); // Saturn
-            planetPositions[7] = glm::vec3(cos(glm::radians(g_animationAngle * 0.01f)) * 85.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.01f)) * 85.0f); // Uranus
-            planetPositions[8] = glm::vec3(cos(glm::radians(g_animationAngle * 0.006f)) * 100.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.006f)) * 100.0f); // Neptune
-        } else {
-            // A planet is selected - Sun stays at center, selected planet orbits around it
-            glm::vec3 orbitPositions[9];
-            orbitPositions[1] = glm::vec3(cos(glm::radians(g_animationAngle * 4.15f)) * 12.0f, 0.0f, sin(glm::radians(g_animationAngle * 4.15f)) * 12.0f); // Mercury
-            orbitPositions[2] = glm::vec3(cos(glm::radians(g_animationAngle * 1.62f)) * 16.0f, 0.0f, sin(glm::radians(g_animationAngle * 1.62f)) * 16.0f); // Venus
-            orbitPositions[3] = glm::vec3(cos(glm::radians(g_animationAngle * 1.0f)) * 22.0f, 0.0f, sin(glm::radians(g_animationAngle * 1.0f)) * 22.0f); // Earth
-            orbitPositions[4] = glm::vec3(cos(glm::radians(g_animationAngle * 0.53f)) * 30.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.53f)) * 30.0f); // Mars
-            orbitPositions[5] = glm::vec3(cos(glm::radians(g_animationAngle * 0.08f)) * 50.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.08f)) * 50.0f); // Jupiter
-            orbitPositions[6] = glm::vec3(cos(glm::radians(g_animationAngle * 0.03f)) * 70.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.03f)) * 70.0f); // Saturn
-            orbitPositions[7] = glm::vec3(cos(glm::radians(g_animationAngle * 0.01f)) * 85.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.01f)) * 85.0f); // Uranus
-            orbitPositions[8] = glm::vec3(cos(glm::radians(g_animationAngle * 0.006f)) * 100.0f, 0.0f, sin(glm::radians(g_animationAngle * 0.006f)) * 100.0f); // Neptune
-            
-            // For non-sun planets, show all but keep them positioned relative to Sun at origin
-            for (int i = 1; i <= 8; i++) {
-                planetPositions[i] = orbitPositions[i];
+        if (!fixedFrameRun) processInput(window);
+        else if (benchOptions.enabled()) bench.applyCamera(frameIndex);
+
+        // --- Apply a window resize once it has settled ---
+        if (lastResizeTime >= 0.0 && glfwGetTime() - lastResizeTime >= RESIZE_SETTLE_SECONDS) {
+            lastResizeTime = -1.0;
+            if (windowWidth != (int)SCR_WIDTH || windowHeight != (int)SCR_HEIGHT) {
+                SCR_WIDTH = windowWidth;
+                SCR_HEIGHT = windowHeight;
+                createFramebuffers(SCR_WIDTH, SCR_HEIGHT);
+                renderTargets.clear(); // Every pooled description was for the old size
+                glStats.invalidate();
             }
         }
-        
-        // --- Update moon positions ---
-        for (int i = 0; i < moons.size(); ++i) {
-            const Moon& moon = moons[i];
-            glm::vec3 parentPos = planetPositions[moon.parentPlanet];
-            float angle = glm::radians(g_animationAngle * moon.orbitSpeed);
-            planetPositions[9 + i] = parentPos + glm::vec3(cos(angle) * moon.orbitRadius, 0.0f, sin(angle) * moon.orbitRadius);
-        }
 
+        // --- Simulation: blend the two latest ticks (rendering one tick behind) ---
+        frameSections.next("Texture uploads");
+        textures.update();
+
+        frameSections.next("Positions");
+        simulation.setTimeScale(timeScale);
+        if (exportOptions.enabled())
+            simulation.advanceTo(exportOptions.startTime + frameIndex * exportOptions.step, frameIndex);
+        else if (benchOptions.enabled())
+            simulation.advanceTo(bench.simulationTime(frameIndex), frameIndex);
+        else if (headless.enabled)
+            simulation.tick(simulation.now());
+        shared_ptr<const SimulationSnapshot> simOlder, simNewer;
+        simulation.latest(simOlder, simNewer);
+        float simAlpha = 1.0f;
+        if (!fixedFrameRun && simOlder->layout == simNewer->layout && simNewer->wallTime > simOlder->wallTime) {
+            double renderTime = simulation.now() - Simulation::TICK_SECONDS;
+            simAlpha = (float)((renderTime - simOlder->wallTime) / (simNewer->wallTime - simOlder->wallTime));
+            simAlpha = glm::clamp(simAlpha, 0.0f, 1.0f);
+        }
+        const SimulationSnapshot& simFrom = (simOlder->layout == simNewer->layout) ? *simOlder : *simNewer;
+        const SimulationSnapshot& simTo = *simNewer;
+        g_simulationTime = simFrom.simulationTime + (simTo.simulationTime - simFrom.simulationTime) * simAlpha;
+        float g_animationAngle = static_cast<float>(g_simulationTime * 20.0);
+        for (size_t i = 0; i < simTo.bodies.size() && i < planetPositions.size(); ++i) {
+            planetPositions[i] = glm::mix(simFrom.bodies[i], simTo.bodies[i], simAlpha);
+        }
         
         // --- View/Projection Matrices (Orbit Camera) ---
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+        frameSections.next("Camera");
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+        float lodPixelScale = SCR_HEIGHT / (2.0f * tan(glm::radians(45.0f) * 0.5f));
         
         // Compute camera target - either planet center or specific location on Earth
         glm::vec3 cameraTarget = planetPositions[focusedPlanet];
@@ -1455,12 +5265,33 @@ int main() {
         }
         
         glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+        updateFrameUniforms(projection, view, cameraPos, planetPositions[0]);
+
+        // Bounding-sphere test against the view frustum, counted for the Performance panel
+        Frustum frustum(projection * view);
+        cullStats = CullStats();
+        auto isVisible = [&](const glm::vec3& center, float radius) {
+            if (useFrustumCulling && !frustum.intersectsSphere(center, radius)) {
+                cullStats.culled++;
+                return false;
+            }
+            cullStats.drawn++;
+            return true;
+        };
+        vector<pair<int, int>> beltRuns;
+
+        // Pick a tessellation level for a body from its projected size
+        auto bodyLOD = [&](const glm::vec3& center, float radius) -> Sphere& {
+            return sphereLODs.select(projectedRadiusPixels(center, radius, cameraPos, lodPixelScale));
+        };
         glm::mat4 model = glm::mat4(1.0f);
         // =================================================================
         // --- STEP 4: FBO PASS 1 (Scene + BrightMap) ---
         // =================================================================
         
-        glBindFramebuffer(GL_FRAMEBUFFER, fboScene);
+        frameSections.end();
+        gpuProfiler.begin("Sky");
+        glStats.bindFramebuffer(GL_FRAMEBUFFER, fboScene);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         
         unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
@@ -1474,214 +5305,224 @@ int main() {
         // --- Draw Sky Sphere (Skymap) ---
         glDepthMask(GL_FALSE);
         skyboxShader.use();
-        glUniform1f(skyTimeLoc, static_cast<float>(g_simulationTime));
+        skyboxShader.set(skyTimeLoc, static_cast<float>(g_simulationTime));
         model = glm::mat4(1.0f);
         model = glm::translate(model, cameraPos); 
         model = glm::scale(model, glm::vec3(400.0f));
         model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        skyboxShader.setMat4("projection", projection);
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, skyTex);
-        sphere.draw();
+        skyboxShader.set(skyboxModelLoc, model);
+        glStats.activeTexture(GL_TEXTURE0);
+        glStats.bindTexture(GL_TEXTURE_2D, skyTex);
+        skySphere.draw();
         glDepthMask(GL_TRUE);
 
 
         // --- Draw Sun (Emissive) ---
-        sunShader.use();
-        sunShader.setFloat("u_time", (float)g_simulationTime);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, planetPositions[0]); 
-        model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * 0.1f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(8.0f));
-        sunShader.setMat4("projection", projection);
-        sunShader.setMat4("view", view);
-        sunShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, sunTex);
-        sphere.draw();
-
-
-        // --- Draw Planets (Lit) ---
-        litShader.use();
-        litShader.setMat4("projection", projection);
-        litShader.setMat4("view", view);
-        litShader.setVec3("viewPos", cameraPos);
-        litShader.setBool("hasTransparency", false);
-        litShader.setFloat("opacity", 1.0f);
-
-        auto drawBody = [&](GLuint tex, glm::vec3 position, float radius, float rotSpeed) {
+        gpuProfiler.begin("Sun");
+        const bool sunInFrustum = isVisible(planetPositions[0], 8.0f * 1.05f); // Radius plus surface displacement
+        glm::mat4 sunModel(1.0f);
+        if (sunInFrustum) {
+            sunShader.use();
+            sunShader.set(sunTimeLoc, (float)g_simulationTime);
             model = glm::mat4(1.0f);
-            model = glm::translate(model, position);
-            model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * rotSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(radius));
-            litShader.setMat4("model", model);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, tex);
-            sphere.draw();
+            model = glm::translate(model, planetPositions[0]); 
+            model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * 0.1f), glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(8.0f));
+            sunModel = model;
+            sunShader.set(sunModelLoc, model);
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, sunTex);
+            bodyLOD(planetPositions[0], 8.0f).draw();
+        }
+
+
+        // --- Queue the lit bodies, their transparent layers and the location markers ---
+        gpuProfiler.begin("Planets");
+        renderQueue.clear();
+        auto submitBody = [&](RenderQueue::Layer layer, int bodyLayer, glm::vec3 position, float radius, float rotSpeed, float opacity) {
+            if (bodyLayer < 0 || !isVisible(position, radius)) return;
+            DrawItem item;
+            item.shader = &litShader;
+            item.texture = textures.arrayTexture();
+            item.layer = textures.layerBinding(bodyLayer);
+            Sphere& mesh = bodyLOD(position, radius);
+            item.vao = mesh.VAO;
+            item.indexCount = mesh.indexCount;
+            item.model = glm::translate(glm::mat4(1.0f), position);
+            item.model = glm::rotate(item.model, glm::radians(g_animationAngle * g_daySpeed * rotSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
+            item.model = glm::rotate(item.model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            item.model = glm::scale(item.model, glm::vec3(radius));
+            item.opacity = opacity;
+            renderQueue.submit(layer, item, glm::length(position - cameraPos), CAMERA_FAR);
+        };
+        auto drawBody = [&](int bodyLayer, glm::vec3 position, float radius, float rotSpeed) {
+            submitBody(RenderQueue::LAYER_OPAQUE, bodyLayer, position, radius, rotSpeed, 1.0f);
+        };
+        // Pointer sphere over a location on a rotating body
+        auto submitMarker = [&](int body, const GeographicLocation& loc, float surfaceRadius, float rotSpeed, float size) {
+            glm::vec3 locPos = latLonToSpherePosition(loc.latitude, loc.longitude, surfaceRadius);
+            float rotation = glm::radians(g_animationAngle * g_daySpeed * rotSpeed);
+            glm::vec3 markerWorldPos = planetPositions[body] + glm::vec3(glm::rotate(glm::mat4(1.0f), rotation, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(locPos, 1.0f));
+            if (!isVisible(markerWorldPos, size)) return;
+            DrawItem item;
+            item.shader = &markerShader;
+            item.vao = lowPolySphere.VAO;
+            item.indexCount = lowPolySphere.indexCount;
+            item.model = glm::scale(glm::translate(glm::mat4(1.0f), markerWorldPos), glm::vec3(size));
+            item.color = loc.color;
+            renderQueue.submit(RenderQueue::LAYER_OPAQUE, item, glm::length(markerWorldPos - cameraPos), CAMERA_FAR);
         };
 
-        drawBody(mercuryTex, planetPositions[1], 1.0f, 0.1f);
-        
-        drawBody(venusTex, planetPositions[2], 1.5f, 0.05f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, planetPositions[2]);
-        model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * 0.03f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.55f));
-        litShader.setMat4("model", model);
-        litShader.setBool("hasTransparency", true);
-        litShader.setFloat("opacity", 0.9f);
-        glBindTexture(GL_TEXTURE_2D, venusAtmoTex);
-        sphere.draw();
-        litShader.setBool("hasTransparency", false);
-        litShader.setFloat("opacity", 1.0f);
-
-        drawBody(earthDayTex, planetPositions[3], 1.6f, 1.0f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, planetPositions[3]);
-        model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * 1.2f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.62f));
-        litShader.setMat4("model", model);
-        litShader.setBool("hasTransparency", true);
-        litShader.setFloat("opacity", 0.8f);
-        glBindTexture(GL_TEXTURE_2D, earthCloudsTex);
-        sphere.draw();
-        litShader.setBool("hasTransparency", false);
-        litShader.setFloat("opacity", 1.0f);
-        
-        // --- Draw Location Pointer on Earth for Selected Location Only ---
-        if (focusedPlanet == 3 && showEarthLocation && currentLocationIndex >= 0 && currentLocationIndex < earthLocations.size()) {  // Earth
-            markerShader.use();
-            
-            // Earth rotation angle
-            float earthRotation = glm::radians(g_animationAngle * g_daySpeed * 1.0f);
-            
-            const GeographicLocation& loc = earthLocations[currentLocationIndex];
-            
-            // Convert lat/lon to 3D position on sphere surface
-            glm::vec3 locPos = latLonToSpherePosition(loc.latitude, loc.longitude, 1.8f);
-            
-            // Apply Earth's rotation to the marker position
-            glm::vec4 rotatedPos = glm::vec4(locPos, 1.0f);
-            rotatedPos = glm::rotate(glm::mat4(1.0f), earthRotation, glm::vec3(0.0f, 1.0f, 0.0f)) * rotatedPos;
-            
-            glm::vec3 markerWorldPos = planetPositions[3] + glm::vec3(rotatedPos);
-            
-            // Create model matrix for marker pointer (larger than before)
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, markerWorldPos);
-            model = glm::scale(model, glm::vec3(0.4f));  // Larger pointer size
-            
-            markerShader.setMat4("model", model);
-            markerShader.setMat4("view", view);
-            markerShader.setMat4("projection", projection);
-            markerShader.setVec3("markerColor", loc.color);  // Pass the location color
-            
-            // Draw marker sphere as pointer
-            lowPolySphere.draw();
-            
-            // Switch back to lit shader for other objects
-            litShader.use();
+        drawBody(mercuryLayer, planetPositions[1], 1.0f, 0.1f);
+        drawBody(venusLayer, planetPositions[2], 1.5f, 0.05f);
+        submitBody(RenderQueue::LAYER_TRANSPARENT, venusAtmoLayer, planetPositions[2], 1.55f, 0.03f, 0.9f);
+        drawBody(earthDayLayer, planetPositions[3], 1.6f, 1.0f);
+        submitBody(RenderQueue::LAYER_TRANSPARENT, earthCloudsLayer, planetPositions[3], 1.62f, 1.2f, 0.8f);
+        if (focusedPlanet == 3 && showEarthLocation && currentLocationIndex >= 0 && currentLocationIndex < earthLocations.size())
+            submitMarker(3, earthLocations[currentLocationIndex], 1.8f, 1.0f, 0.4f);
+        if (focusedPlanet == 6 && showSaturnLocation && currentSaturnLocationIndex >= 0 && currentSaturnLocationIndex < saturnLocations.size())
+            submitMarker(6, saturnLocations[currentSaturnLocationIndex], 4.7f, 0.45f, 0.5f); // Saturn rotates slower
+        drawBody(marsLayer, planetPositions[4], 1.2f, 0.9f);
+        for (int i = 0; i < moons.size(); ++i) {
+            drawBody(moonLayer, planetPositions[9 + i], moons[i].size, 0.5f);
         }
-        
-        // --- Draw Location Pointer on Saturn for Selected Location Only ---
-        if (focusedPlanet == 6 && showSaturnLocation && currentSaturnLocationIndex >= 0 && currentSaturnLocationIndex < saturnLocations.size()) {  // Saturn
-            markerShader.use();
-            
-            // Saturn rotation angle (Saturn rotates slower)
-            float saturnRotation = glm::radians(g_animationAngle * g_daySpeed * 0.45f);
-            
-            const GeographicLocation& loc = saturnLocations[currentSaturnLocationIndex];
-            
-            // Convert lat/lon to 3D position on sphere surface
-            glm::vec3 locPos = latLonToSpherePosition(loc.latitude, loc.longitude, 4.7f);  // Saturn radius
-            
-            // Apply Saturn's rotation to the marker position (keep fixed on Saturn)
-            glm::vec4 rotatedPos = glm::vec4(locPos, 1.0f);
-            rotatedPos = glm::rotate(glm::mat4(1.0f), saturnRotation, glm::vec3(0.0f, 1.0f, 0.0f)) * rotatedPos;
-            
-            glm::vec3 markerWorldPos = planetPositions[6] + glm::vec3(rotatedPos);
-            
-            // Create model matrix for marker pointer
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, markerWorldPos);
-            model = glm::scale(model, glm::vec3(0.5f));  // Slightly larger for Saturn
-            
-            markerShader.setMat4("model", model);
-            markerShader.setMat4("view", view);
-            markerShader.setMat4("projection", projection);
-            markerShader.setVec3("markerColor", loc.color);  // Pass the location color
-            
-            // Draw marker sphere as pointer
-            lowPolySphere.draw();
-            
-            // Switch back to lit shader for other objects
-            litShader.use();
+        drawBody(jupiterLayer, planetPositions[5], 5.0f, 2.2f);
+        drawBody(saturnLayer, planetPositions[6], 4.5f, 2.1f);
+        if (saturnRingLayer >= 0 && isVisible(planetPositions[6], 9.0f)) { // Ring outer radius
+            DrawItem ring;
+            ring.shader = &litShader;
+            ring.texture = textures.arrayTexture();
+            ring.layer = textures.layerBinding(saturnRingLayer);
+            ring.vao = ringVAO;
+            ring.indexCount = ringIndexCount;
+            ring.model = glm::rotate(glm::translate(glm::mat4(1.0f), planetPositions[6]), glm::radians(15.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            renderQueue.submit(RenderQueue::LAYER_TRANSPARENT, ring, glm::length(planetPositions[6] - cameraPos), CAMERA_FAR);
         }
-        
-        drawBody(marsTex, planetPositions[4], 1.2f, 0.9f);
-        
-        // --- Draw Moons (same as Mars - simple sphere rendering) ---
-        for (int i = 0; i < moons.size(); ++i) {
-            const Moon& moon = moons[i];
-            // Use moon texture for all moons
-            drawBody(moonTex, planetPositions[9 + i], moon.size, 0.5f);
+        drawBody(uranusLayer, planetPositions[7], 3.5f, 1.3f);
+        drawBody(neptuneLayer, planetPositions[8], 3.3f, 1.4f);
+
+        auto applyDrawItem = [&](const DrawItem& item, bool materialChanged) {
+            if (item.shader == &markerShader) {
+                markerShader.set(markerModelLoc, item.model);
+                markerShader.set(markerColorLoc, item.color);
+                return;
+            }
+            litShader.set(litModelLoc, item.model);
+            litShader.set(litBodyLayerLoc, item.layer);
+            if (materialChanged) {
+                litShader.set(litHasTransparencyLoc, item.transparent);
+                litShader.set(litOpacityLoc, item.opacity);
+            }
+        };
+        if (useMultiDrawIndirect) renderQueue.executeIndirect(RenderQueue::LAYER_OPAQUE, indirectShader, indirectDraws, applyDrawItem);
+        else renderQueue.execute(RenderQueue::LAYER_OPAQUE, applyDrawItem);
+
+        // --- Draw Inner Asteroid Belt ---
+        gpuProfiler.begin("Asteroid belt");
+        // Only rocks in visible sectors get transforms computed, uploaded and drawn
+        const glm::vec4 asteroidBinding = textures.layerBinding(asteroidLayer);
+        glStats.bindTexture(GL_TEXTURE_2D_ARRAY, textures.arrayTexture());
+        visibleBeltRuns(simTo.beltSectors, frustum, 0.0f, beltRuns);
+        for (const auto& run : beltRuns) {
+            for (int i = run.first; i < run.first + run.second; i++) {
+                glm::vec3 from(simFrom.beltX[i], simFrom.beltY[i], simFrom.beltZ[i]);
+                glm::vec3 to(simTo.beltX[i], simTo.beltY[i], simTo.beltZ[i]);
+                model = glm::mat4(simTo.beltSize[i]);
+                model[3] = glm::vec4(glm::mix(from, to, simAlpha), 1.0f);
+                asteroidMatrices[i] = model;
+            }
         }
-
-        glBindTexture(GL_TEXTURE_2D, asteroidTex);
-        float asteroidOrbitSpeed = g_animationAngle * 0.05f;
-        for (int i = 0; i < ASTEROID_COUNT; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::rotate(model, glm::radians(asteroidOrbitSpeed + asteroidBelt[i].angle), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::translate(model, glm::vec3(asteroidBelt[i].orbitRadius, asteroidBelt[i].yOffset, 0.0f));
-            model = glm::scale(model, glm::vec3(asteroidBelt[i].size));
-            litShader.setMat4("model", model);
-            lowPolySphere.draw();
+        if (useInstancedAsteroids) {
+            // Orphan the buffer so the upload never waits on last frame's draw
+            glBindBuffer(GL_ARRAY_BUFFER, asteroidInstanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, asteroidCount * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+            for (const auto& run : beltRuns)
+                glBufferSubData(GL_ARRAY_BUFFER, run.first * sizeof(glm::mat4), run.second * sizeof(glm::mat4), &asteroidMatrices[run.first]);
+
+            asteroidShader.use();
+            asteroidShader.set(asteroidBodyLayerLoc, asteroidBinding);
+            if (useMultiDrawIndirect) {
+                indirectDraws.drawRuns(lowPolySphere.VAO, lowPolySphere.indexCount, beltRuns);
+            } else {
+                for (const auto& run : beltRuns)
+                    lowPolySphere.drawInstanced(run.second, run.first);
+            }
+        } else {
+            litShader.use();
+            litShader.set(litHasTransparencyLoc, false);
+            litShader.set(litOpacityLoc, 1.0f);
+            litShader.set(litBodyLayerLoc, asteroidBinding);
+            for (const auto& run : beltRuns) {
+                for (int i = run.first; i < run.first + run.second; i++) {
+                    litShader.set(litModelLoc, asteroidMatrices[i]);
+                    lowPolySphere.draw();
+                }
+            }
         }
 
-        drawBody(jupiterTex, planetPositions[5], 5.0f, 2.2f);
-        
-        drawBody(saturnTex, planetPositions[6], 4.5f, 2.1f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, planetPositions[6]);
-        model = glm::rotate(model, glm::radians(15.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        litShader.setMat4("model", model);
-        litShader.setBool("hasTransparency", true);
-        litShader.setFloat("opacity", 1.0f);
-        glBindTexture(GL_TEXTURE_2D, saturnRingTex);
-        glBindVertexArray(ringVAO);
-        glDrawElements(GL_TRIANGLES, ringIndexCount, GL_UNSIGNED_INT, 0);
-        litShader.setBool("hasTransparency", false);
-
-        drawBody(uranusTex, planetPositions[7], 3.5f, 1.3f);
-        drawBody(neptuneTex, planetPositions[8], 3.3f, 1.4f);
-        
         // --- Draw Outer Asteroid Belt (Kuiper Belt) ---
-        glBindTexture(GL_TEXTURE_2D, asteroidTex);
-        srand(12345); // Fixed seed for consistent outer belt
-        for (int i = 0; i < ASTEROID_COUNT * 25; i++) {  // Same count as inner belt
-            model = glm::mat4(1.0f);
-            float outerOrbitSpeed = g_animationAngle * 0.005f;
-            float outerRadius = 115.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 25.0f));
-            float outerAngle = static_cast<float>(rand() % 360);
-            model = glm::rotate(model, glm::radians(outerOrbitSpeed + outerAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::translate(model, glm::vec3(outerRadius, -1.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 2.0f)), 0.0f));
-            float outerSize = 0.012f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 0.025f));
-            model = glm::scale(model, glm::vec3(outerSize));
-            litShader.setMat4("model", model);
-            lowPolySphere.draw();
+        gpuProfiler.begin("Kuiper belt");
+        glStats.bindTexture(GL_TEXTURE_2D_ARRAY, textures.arrayTexture());
+        float outerOrbitSpeed = g_animationAngle * 0.005f;
+        visibleBeltRuns(kuiperSectors, frustum, outerOrbitSpeed, beltRuns);
+        if (useInstancedAsteroids) {
+            beltShader.use();
+            beltShader.set(beltOrbitAngleLoc, outerOrbitSpeed);
+            beltShader.set(beltBodyLayerLoc, asteroidBinding);
+            if (useMultiDrawIndirect) {
+                indirectDraws.drawRuns(kuiperVAO, lowPolySphere.indexCount, beltRuns);
+            } else {
+                glStats.bindVertexArray(kuiperVAO);
+                for (const auto& run : beltRuns) {
+                    glStats.drawElementsInstancedBaseInstance(GL_TRIANGLES, lowPolySphere.indexCount, GL_UNSIGNED_INT, 0, run.second, run.first);
+                }
+            }
+        } else {
+            litShader.use();
+            litShader.set(litHasTransparencyLoc, false);
+            litShader.set(litOpacityLoc, 1.0f);
+            litShader.set(litBodyLayerLoc, asteroidBinding);
+            for (const auto& run : beltRuns) {
+                for (int i = run.first; i < run.first + run.second; i++) {
+                    model = glm::mat4(1.0f);
+                    model = glm::rotate(model, glm::radians(outerOrbitSpeed + kuiperBelt[i].angle), glm::vec3(0.0f, 1.0f, 0.0f));
+                    model = glm::translate(model, glm::vec3(kuiperBelt[i].orbitRadius, kuiperBelt[i].yOffset, 0.0f));
+                    model = glm::scale(model, glm::vec3(kuiperBelt[i].size));
+                    litShader.set(litModelLoc, model);
+                    lowPolySphere.draw();
+                }
+            }
         }
         
      
+        // --- Sun occlusion query (for skipping god rays), after every opaque pass ---
+        // Redraws the same Sun mesh depth-tested only; LEQUAL lets its own depth pass
+        if (sunInFrustum) {
+            sunShader.use();
+            sunShader.set(sunModelLoc, sunModel);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+            sunOcclusion.begin();
+            bodyLOD(planetPositions[0], 8.0f).draw();
+            sunOcclusion.end();
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+
+        // --- Transparent layers (Venus atmosphere, Earth clouds, Saturn ring), far to near ---
+        // Tested against the opaque depth but not written, so overlapping layers all blend
+        gpuProfiler.begin("Transparent");
+        glDepthMask(GL_FALSE);
+        if (useMultiDrawIndirect) renderQueue.executeIndirect(RenderQueue::LAYER_TRANSPARENT, indirectShader, indirectDraws, applyDrawItem);
+        else renderQueue.execute(RenderQueue::LAYER_TRANSPARENT, applyDrawItem);
+        glDepthMask(GL_TRUE);
+
         // --- Draw Orbits ---
+        gpuProfiler.begin("Orbits");
         glLineWidth(1.2f);
         orbitShader.use();
-        orbitShader.setMat4("projection", projection);
-        orbitShader.setMat4("view", view);
         
         // Color array for orbits
         glm::vec3 orbitColors[9] = {
@@ -1698,10 +5539,13 @@ int main() {
         
         // Show all orbits as dotted lines with low opacity
         for (int i = 0; i < 9; ++i) {
-            // Skip moon orbit when not focused on Earth
-            if (i == 8 && focusedPlanet != 3) continue;
+            // Skip moon orbit when not focused on Earth, or once the Moon has been removed
+            if (i == 8 && (focusedPlanet != 3 || orbitParams[8].body < 0 || orbitVAO[8] == 0)) continue;
             
-            glBindVertexArray(orbitVAO[i]);
+            glm::vec3 orbitCenter = (i == 8) ? planetPositions[3] : glm::vec3(0.0f);
+            if (!isVisible(orbitCenter, ephemeris.apoapsis(orbitParams[i].body))) continue;
+            
+            glStats.bindVertexArray(orbitVAO[i]);
             model = glm::mat4(1.0f);
             
             // For moon, position at Earth
@@ -1709,10 +5553,10 @@ int main() {
                 model = glm::translate(model, planetPositions[3]);
             }
             
-            orbitShader.setMat4("model", model);
-            orbitShader.setVec3("orbitColor", orbitColors[i] * 0.4f);  // Low opacity effect via color dimming
+            orbitShader.set(orbitModelLoc, model);
+            orbitShader.set(orbitColorLoc, orbitColors[i] * 0.4f);  // Low opacity effect via color dimming
             
-            glDrawElements(GL_LINES, orbitIndexCount[i], GL_UNSIGNED_INT, 0);
+            glStats.drawElements(GL_LINES, orbitIndexCount[i], GL_UNSIGNED_INT, 0);
         }
         glLineWidth(1.0f);
 
@@ -1722,7 +5566,8 @@ int main() {
         bool shouldShowMinimap = (focusedPlanet == 3 && showEarthLocation) || (focusedPlanet == 6 && showSaturnLocation);
         
         if (shouldShowMinimap) {
-            glBindFramebuffer(GL_FRAMEBUFFER, fboMinimap);
+            gpuProfiler.begin("Minimap");
+            glStats.bindFramebuffer(GL_FRAMEBUFFER, fboMinimap);
             glViewport(0, 0, MINIMAP_WIDTH, MINIMAP_HEIGHT);
             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1733,69 +5578,66 @@ int main() {
             glm::mat4 minimapProjection = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, 0.1f, 1000.0f);
             glm::vec3 minimapCameraPos = glm::vec3(0.0f, 150.0f, 0.0f);  // Higher up for better view
             glm::mat4 minimapView = glm::lookAt(minimapCameraPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+            float minimapPixelsPerUnit = MINIMAP_HEIGHT / (2.0f * orthoSize);
+            updateFrameUniforms(minimapProjection, minimapView, minimapCameraPos, planetPositions[0]);
 
             // Draw minimap sun
             sunShader.use();
-            sunShader.setFloat("u_time", (float)g_simulationTime);
+            sunShader.set(sunTimeLoc, (float)g_simulationTime);
             model = glm::mat4(1.0f);
             model = glm::translate(model, planetPositions[0]);
             model = glm::rotate(model, glm::radians(g_animationAngle * g_daySpeed * 0.1f), glm::vec3(0.0f, 1.0f, 0.0f));
             model = glm::scale(model, glm::vec3(2.0f));  // Smaller sun for minimap
-            sunShader.setMat4("projection", minimapProjection);
-            sunShader.setMat4("view", minimapView);
-            sunShader.setMat4("model", model);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, sunTex);
-            sphere.draw();
+            sunShader.set(sunModelLoc, model);
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, sunTex);
+            sphereLODs.select(2.0f * minimapPixelsPerUnit).draw();
 
             // Draw minimap planets
             litShader.use();
-            litShader.setMat4("projection", minimapProjection);
-            litShader.setMat4("view", minimapView);
-            litShader.setVec3("viewPos", minimapCameraPos);
-            litShader.setBool("hasTransparency", false);
-            litShader.setFloat("opacity", 1.0f);
+            litShader.set(litHasTransparencyLoc, false);
+            litShader.set(litOpacityLoc, 1.0f);
 
-            auto drawMiniPlanet = [&](GLuint tex, glm::vec3 position, float radius) {
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D_ARRAY, textures.arrayTexture());
+            auto drawMiniPlanet = [&](int bodyLayer, glm::vec3 position, float radius) {
+                if (bodyLayer < 0) return;
                 model = glm::mat4(1.0f);
                 model = glm::translate(model, position);
                 model = glm::scale(model, glm::vec3(radius));
-                litShader.setMat4("model", model);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, tex);
-                sphere.draw();
+                litShader.set(litModelLoc, model);
+                litShader.set(litBodyLayerLoc, textures.layerBinding(bodyLayer));
+                sphereLODs.select(radius * minimapPixelsPerUnit).draw();
             };
 
             // Draw all 8 planets with scaled radii for visibility
-            drawMiniPlanet(mercuryTex, planetPositions[1], 0.3f);
-            drawMiniPlanet(venusTex, planetPositions[2], 0.5f);
-            drawMiniPlanet(earthDayTex, planetPositions[3], 0.5f);
-            drawMiniPlanet(marsTex, planetPositions[4], 0.4f);
-            drawMiniPlanet(jupiterTex, planetPositions[5], 1.5f);
-            drawMiniPlanet(saturnTex, planetPositions[6], 1.3f);
-            drawMiniPlanet(uranusTex, planetPositions[7], 0.8f);
-            drawMiniPlanet(neptuneTex, planetPositions[8], 0.8f);
+            drawMiniPlanet(mercuryLayer, planetPositions[1], 0.3f);
+            drawMiniPlanet(venusLayer, planetPositions[2], 0.5f);
+            drawMiniPlanet(earthDayLayer, planetPositions[3], 0.5f);
+            drawMiniPlanet(marsLayer, planetPositions[4], 0.4f);
+            drawMiniPlanet(jupiterLayer, planetPositions[5], 1.5f);
+            drawMiniPlanet(saturnLayer, planetPositions[6], 1.3f);
+            drawMiniPlanet(uranusLayer, planetPositions[7], 0.8f);
+            drawMiniPlanet(neptuneLayer, planetPositions[8], 0.8f);
             
             // Draw orbit lines for reference
             glLineWidth(0.5f);
             orbitShader.use();
-            orbitShader.setMat4("projection", minimapProjection);
-            orbitShader.setMat4("view", minimapView);
             
             glm::vec3 orbitColor = glm::vec3(0.3f, 0.3f, 0.3f);  // Dark gray orbits
             
             for (int i = 0; i < 8; ++i) {  // Draw all 8 planet orbits
-                glBindVertexArray(orbitVAO[i]);
+                glStats.bindVertexArray(orbitVAO[i]);
                 model = glm::mat4(1.0f);
-                orbitShader.setMat4("model", model);
-                orbitShader.setVec3("orbitColor", orbitColor);
-                glDrawElements(GL_LINES, orbitIndexCount[i], GL_UNSIGNED_INT, 0);
+                orbitShader.set(orbitModelLoc, model);
+                orbitShader.set(orbitColorLoc, orbitColor);
+                glStats.drawElements(GL_LINES, orbitIndexCount[i], GL_UNSIGNED_INT, 0);
             }
             glLineWidth(1.0f);
         }
 
         // Bind back to main FBO for post-processing
-        glBindFramebuffer(GL_FRAMEBUFFER, fboScene);
+        glStats.bindFramebuffer(GL_FRAMEBUFFER, fboScene);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
         // =================================================================
@@ -1803,67 +5645,153 @@ int main() {
         // =================================================================
         
         glDisable(GL_DEPTH_TEST);
-        glBindVertexArray(quadVAO);
+        glStats.bindVertexArray(quadVAO);
 
         // =================================================================
         // --- STEP 5: FBO PASS 2 (Bloom) ---
         // =================================================================
         
-        gaussianBlurShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        gaussianBlurShader.setInt("u_image", 0);
+        // Workgroups of n invocations needed to cover size pixels
+        auto groups = [](int size, int n) { return (GLuint)((size + n - 1) / n); };
+        const int width = (int)SCR_WIDTH, height = (int)SCR_HEIGHT;
+
+        // Post targets come from the pool and go back as soon as their last reader is issued
+        RenderTarget* bloomTarget = nullptr; // Read by the composite
+        if (useComputePost) {
+            gpuProfiler.begin("Bloom (compute)");
+            RenderTargetDesc quarter{ max(1, width / 4), max(1, height / 4), GL_R11F_G11F_B10F };
+            RenderTarget* ping[2] = { renderTargets.acquire(quarter), renderTargets.acquire(quarter) };
+            glStats.activeTexture(GL_TEXTURE0);
+            bloomPrefilterCompute.use();
+            glStats.bindTexture(GL_TEXTURE_2D, texBrightMap);
+            glBindImageTexture(0, ping[0]->texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+            glStats.dispatchCompute(groups(quarter.width, 8), groups(quarter.height, 8), 1);
+
+            // Two blurs ping-pong 0 -> 1 -> 0 for a wider glow (sigma ~23 px at full resolution)
+            bloomBlurCompute.use();
+            for (int i = 0; i < 2; i++) {
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+                glStats.bindTexture(GL_TEXTURE_2D, ping[i]->texture);
+                glBindImageTexture(0, ping[i ^ 1]->texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+                glStats.dispatchCompute(groups(quarter.width, 16), groups(quarter.height, 16), 1);
+            }
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            bloomTarget = ping[0];
+            renderTargets.release(ping[1]);
+        } else {
+            gpuProfiler.begin("Bloom");
+            RenderTarget* mips[BLOOM_MIP_COUNT];
+            for (int i = 0; i < BLOOM_MIP_COUNT; i++)
+                mips[i] = renderTargets.acquire({ max(1, width >> (i + 1)), max(1, height >> (i + 1)), GL_R11F_G11F_B10F });
+            glStats.activeTexture(GL_TEXTURE0);
+
+            // Downsample the bright map through the chain (13 taps per texel, each level a quarter of the last)
+            bloomDownsampleShader.use();
+            for (int i = 0; i < BLOOM_MIP_COUNT; i++) {
+                glStats.bindFramebuffer(GL_FRAMEBUFFER, mips[i]->fbo);
+                glViewport(0, 0, mips[i]->desc.width, mips[i]->desc.height);
+                bloomDownsampleShader.set(bloomKarisAverageLoc, i == 0);
+                glStats.bindTexture(GL_TEXTURE_2D, i == 0 ? texBrightMap : mips[i - 1]->texture);
+                glStats.drawArrays(GL_TRIANGLES, 0, 6);
+            }
 
-        bool horizontal = true;
-        bool first_iteration = true;
-        int amount = 4; // Reduced from 10
-        
-        for (int i = 0; i < amount; i++) {
-            glBindFramebuffer(GL_FRAMEBUFFER, fboBloom[horizontal]); 
-            gaussianBlurShader.setBool("u_horizontal", horizontal);
-            
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? texBrightMap : texBloom[!horizontal]);
-            
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            
-            horizontal = !horizontal;
-            if (first_iteration) {
-                first_iteration = false;
+            // Upsample back to level 0, adding each blurred level onto the next larger one
+            bloomUpsampleShader.use();
+            glBlendFunc(GL_ONE, GL_ONE);
+            for (int i = BLOOM_MIP_COUNT - 1; i > 0; i--) {
+                glStats.bindFramebuffer(GL_FRAMEBUFFER, mips[i - 1]->fbo);
+                glViewport(0, 0, mips[i - 1]->desc.width, mips[i - 1]->desc.height);
+                glStats.bindTexture(GL_TEXTURE_2D, mips[i]->texture);
+                glStats.drawArrays(GL_TRIANGLES, 0, 6);
+                renderTargets.release(mips[i]);
             }
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glViewport(0, 0, width, height);
+            bloomTarget = mips[0];
         }
 
         // =================================================================
         // --- STEP 6: FBO PASS 3 (God Rays) ---
         // =================================================================
         
-        glBindFramebuffer(GL_FRAMEBUFFER, fboGodRays);
-        godRayShader.use();
-        
+        gpuProfiler.begin("God rays");
         glm::vec4 sunClipSpace = projection * view * glm::vec4(planetPositions[0], 1.0);
         glm::vec3 sunNDC = glm::vec3(sunClipSpace) / sunClipSpace.w;
         glm::vec2 sunScreenPos = glm::vec2(sunNDC.x + 1.0, sunNDC.y + 1.0) * 0.5f;
-        godRayShader.setVec2("u_sunScreenPos", sunScreenPos);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texBrightMap); 
-        godRayShader.setInt("u_brightTexture", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // Skip the pass when the Sun is behind the camera, well outside the view (its rays
+        // would barely reach the screen) or hidden behind a planet
+        const char* godRayStatus = "on";
+        if (sunClipSpace.w <= 0.0f || sunScreenPos.x < -0.5f || sunScreenPos.x > 1.5f ||
+            sunScreenPos.y < -0.5f || sunScreenPos.y > 1.5f) {
+            godRayStatus = "skipped (Sun off-screen)";
+        } else if (sunInFrustum && sunOcclusion.occluded) {
+            godRayStatus = "skipped (Sun occluded)";
+        }
+        const bool drawGodRays = godRayStatus[0] == 'o';
+
+        RenderTarget* godRayTarget = nullptr;
+        if (drawGodRays) {
+            // At quarter resolution this reuses the bloom level 1 target released above
+            godRayTarget = renderTargets.acquire({ max(1, width / godRayDownscale), max(1, height / godRayDownscale), GL_R11F_G11F_B10F });
+            glStats.bindFramebuffer(GL_FRAMEBUFFER, godRayTarget->fbo);
+            glViewport(0, 0, godRayTarget->desc.width, godRayTarget->desc.height);
+            godRayShader.use();
+            godRayShader.set(godRaySunScreenPosLoc, sunScreenPos);
+            godRayShader.set(godRayNumSamplesLoc, godRaySamples);
+
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, texBrightMap); 
+            glStats.drawArrays(GL_TRIANGLES, 0, 6);
+            glViewport(0, 0, width, height);
+        }
 
 
         // =================================================================
         // --- STEP 7: FBO PASS 4 (Composite) ---
         // =================================================================
         
-        glBindFramebuffer(GL_FRAMEBUFFER, fboComposite);
-        compositeShader.use();
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texSceneColor);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texBloom[0]); 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, texGodRays);
+        // The LDR final target only exists when something reads it back or the compute chain writes it
+        RenderTarget* finalTarget = (useComputePost || fixedFrameRun) ? renderTargets.acquire({ width, height, GL_RGBA8 }) : nullptr;
+        RenderTarget* compositeTarget = nullptr;
+        if (useComputePost) {
+            // Composite, tone map and gamma in one dispatch; replaces the composite and final-blit passes
+            gpuProfiler.begin("Composite (compute)");
+            fusedCompositeCompute.use();
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, texSceneColor);
+            glStats.activeTexture(GL_TEXTURE1);
+            glStats.bindTexture(GL_TEXTURE_2D, bloomTarget->texture);
+            glStats.activeTexture(GL_TEXTURE2);
+            glStats.bindTexture(GL_TEXTURE_2D, godRayTarget ? godRayTarget->texture : 0);
+            glStats.activeTexture(GL_TEXTURE3);
+            glStats.bindTexture(GL_TEXTURE_2D, texSceneDepth);
+            fusedCompositeCompute.set(fusedGodRaysEnabledLoc, drawGodRays);
+            glBindImageTexture(0, finalTarget->texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glStats.dispatchCompute(groups(width, 8), groups(height, 8), 1);
+            glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT); // Blit / readback go through the final target's FBO
+            glStats.activeTexture(GL_TEXTURE0);
+        } else {
+            gpuProfiler.begin("Composite");
+            compositeTarget = renderTargets.acquire({ width, height, GL_RGBA16F });
+            glStats.bindFramebuffer(GL_FRAMEBUFFER, compositeTarget->fbo);
+            compositeShader.use();
+
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, texSceneColor);
+            glStats.activeTexture(GL_TEXTURE1);
+            glStats.bindTexture(GL_TEXTURE_2D, bloomTarget->texture);
+            glStats.activeTexture(GL_TEXTURE2);
+            glStats.bindTexture(GL_TEXTURE_2D, godRayTarget ? godRayTarget->texture : 0);
+            glStats.activeTexture(GL_TEXTURE3);
+            glStats.bindTexture(GL_TEXTURE_2D, texSceneDepth);
+            compositeShader.set(compositeGodRaysEnabledLoc, drawGodRays);
         
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+            glStats.drawArrays(GL_TRIANGLES, 0, 6);
+            glStats.activeTexture(GL_TEXTURE0);
+        }
+        renderTargets.release(bloomTarget);
+        renderTargets.release(godRayTarget);
 
 
         // =================================================================
@@ -1877,21 +5805,60 @@ int main() {
         // --- STEP 9/10: Render to ImGui / FINAL RENDER TO SCREEN ---
         // =================================================================
         
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        if (exportOptions.enabled()) {
+            gpuProfiler.begin("Export readback");
+            glStats.bindFramebuffer(GL_READ_FRAMEBUFFER, useComputePost ? finalTarget->fbo : compositeTarget->fbo);
+            exporter.capture(frameIndex);
+        }
+
+        if (useComputePost) {
+            // The final target already holds the image: headless reads it in place, a window gets a copy
+            glStats.bindFramebuffer(GL_FRAMEBUFFER, finalTarget->fbo);
+            if (!fixedFrameRun) {
+                gpuProfiler.begin("Final blit");
+                glStats.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+                glStats.bindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+        } else {
+            gpuProfiler.begin("Final blit");
+            glStats.bindFramebuffer(GL_FRAMEBUFFER, fixedFrameRun ? finalTarget->fbo : 0);
+            if (fixedFrameRun) glViewport(0, 0, width, height);
+            else glViewport(0, 0, windowWidth, windowHeight); // Stretches while a resize settles
         
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            finalScreenShader.use();
+            glStats.activeTexture(GL_TEXTURE0);
+            glStats.bindTexture(GL_TEXTURE_2D, compositeTarget->texture);
+            glStats.drawArrays(GL_TRIANGLES, 0, 6);
+        }
+        gpuProfiler.end();
+        renderTargets.release(compositeTarget);
 
-        finalScreenShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texComposite); // <-- MODIFIED: Bind composite texture
-        glDrawArrays(GL_TRIANGLES, 0, 6); 
+        if (fixedFrameRun) {
+            if (benchOptions.enabled()) {
+                glFinish();
+                bench.record(frameIndex, chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count(), glStats.frameTotal());
+            }
+            ++frameIndex;
+            if (frameIndex == headless.frames && !headless.outputPath.empty()) {
+                if (writeFramebufferPPM(headless.outputPath, width, height))
+                    cout << "Wrote " << headless.outputPath << endl;
+            }
+            renderTargets.release(finalTarget);
+            renderTargets.endFrame();
+            continue; // No UI or window to present
+        }
+        renderTargets.release(finalTarget);
+        renderTargets.endFrame();
 
 
         // =================================================================
         // --- STEP 10: RENDER IMGUI UI ---
         // =================================================================
+        frameSections.next("ImGui build");
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -2029,6 +5996,133 @@ int main() {
             ImGui::End();
         }
         
+        // --- Performance Panel (Top-Right) ---
+        unsigned int frameUniformLookups = Shader::s_uniformLookups; // Render passes only, before ImGui
+        ImGui::SetNextWindowPos(ImVec2(SCR_WIDTH - 330.0f, 10));
+        ImGui::SetNextWindowSize(ImVec2(320, 450));
+        ImGui::Begin("Performance", NULL, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
+        ImGui::Text("Frame: %.2f ms (%.0f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Checkbox("Instanced asteroid belts (I)", &useInstancedAsteroids);
+        ImGui::SameLine();
+        ImGui::Checkbox("MDI", &useMultiDrawIndirect);
+        ImGui::Checkbox("Frustum culling", &useFrustumCulling);
+        ImGui::SameLine();
+        ImGui::Checkbox("GL calls", &showGLStats);
+        ImGui::Checkbox("Compute post chain", &useComputePost);
+        ImGui::Text("Objects drawn: %u  culled: %u", cullStats.drawn, cullStats.culled);
+        ImGui::Text("Uniform name lookups: %u", frameUniformLookups);
+        GLCallCounters glFrame = glStats.frameTotal();
+        ImGui::Text("Draw calls: %u  triangles: %llu", glFrame.drawCalls, glFrame.triangles);
+        ImGui::Text("Simulation: %.0f Hz, tick %.2f ms", 1.0 / Simulation::TICK_SECONDS, simNewer->tickMs);
+        ImGui::Text("Belt: %d bodies (%s Kepler)", (int)simNewer->beltSize.size(), LanesBest::name());
+        if (textures.pending() > 0) ImGui::Text("Streaming textures: %d pending", textures.pending());
+        ImGui::SliderFloat("LOD error (px)", &sphereLODs.maxErrorPixels, 0.1f, 4.0f, "%.2f");
+        ImGui::Text("God rays: %s", godRayStatus);
+        ImGui::SliderInt("God-ray samples", &godRaySamples, 8, 128);
+        static const char* godRayScales[] = { "Half", "Quarter" };
+        int godRayScaleIndex = godRayDownscale == 4 ? 1 : 0;
+        if (ImGui::Combo("God-ray resolution", &godRayScaleIndex, godRayScales, 2)) {
+            godRayDownscale = godRayScaleIndex == 1 ? 4 : 2; // The pool picks up the new size next frame
+        }
+        ImGui::Text("Render targets: %.1f MB (scene %.1f + pool %.1f)",
+                    (sceneTargetBytes + renderTargets.bytes()) / 1048576.0, sceneTargetBytes / 1048576.0, renderTargets.bytes() / 1048576.0);
+        ImGui::Text("Pool: %zu targets, %u reused / %u created", renderTargets.count(),
+                    renderTargets.reusedLastFrame, renderTargets.createdLastFrame);
+        if (textures.layersReady())
+            ImGui::Text("Body array: %d x %dx%d %s, %.1f MB, %.0f ms", textures.layers(), textures.layerWidth(),
+                        textures.layerHeight(), textures.arrayCompressed() ? "BC3" : "RGBA8",
+                        textures.arrayBytes() / 1048576.0, textures.arrayUploadMs());
+        if (traceFramesRemaining > 0) {
+            ImGui::Text("Recording CPU trace... %d frames left", traceFramesRemaining);
+        } else if (ImGui::Button("Record CPU trace (120 frames)") && !cpuTrace.recording()) {
+            cpuTrace.start();
+            traceFramesRemaining = 120;
+        }
+        ImGui::End();
+
+        // --- GPU Pass Timings (below Performance) ---
+        ImGui::SetNextWindowPos(ImVec2(SCR_WIDTH - 330.0f, 470));
+        ImGui::SetNextWindowSize(ImVec2(320, 330));
+        ImGui::Begin("GPU Passes", NULL, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
+        vector<GpuProfiler::PassStats> passStats = gpuProfiler.stats();
+        if (ImGui::BeginTable("passes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("last");
+            ImGui::TableSetupColumn("min");
+            ImGui::TableSetupColumn("avg");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableHeadersRow();
+            float totalLast = 0.0f, totalAvg = 0.0f;
+            for (const GpuProfiler::PassStats& s : passStats) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(s.name.c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", s.lastMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", s.minMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", s.avgMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.2f", s.p99Ms);
+                totalLast += s.lastMs;
+                totalAvg += s.avgMs;
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted("Total");
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", totalLast);
+            ImGui::TableNextColumn();
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", totalAvg);
+            ImGui::EndTable();
+        }
+        ImGui::Text("ms over last %d frames; dropped: %u", GpuProfiler::HISTORY, gpuProfiler.droppedFrames);
+        if (ImGui::Button("Dump CSV")) {
+            if (gpuProfiler.writeCSV("gpu_passes.csv")) cout << "Wrote gpu_passes.csv" << endl;
+        }
+        ImGui::End();
+
+        // --- GL call counts per pass (Performance panel checkbox) ---
+        if (showGLStats) {
+            ImGui::SetNextWindowPos(ImVec2(10, 370));
+            ImGui::SetNextWindowSize(ImVec2(640, 330));
+            ImGui::Begin("GL Calls", &showGLStats, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
+            if (ImGui::BeginTable("glcalls", 8, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+                ImGui::TableSetupColumn("Pass");
+                ImGui::TableSetupColumn("draws");
+                ImGui::TableSetupColumn("tris");
+                ImGui::TableSetupColumn("programs");
+                ImGui::TableSetupColumn("textures");
+                ImGui::TableSetupColumn("FBOs");
+                ImGui::TableSetupColumn("VAOs");
+                ImGui::TableSetupColumn("uniforms");
+                ImGui::TableHeadersRow();
+                // Binds read "issued/redundant"
+                auto row = [](const char* name, const GLCallCounters& c) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(name);
+                    ImGui::TableNextColumn(); ImGui::Text("%u", c.drawCalls);
+                    ImGui::TableNextColumn(); ImGui::Text("%llu", c.triangles);
+                    ImGui::TableNextColumn(); ImGui::Text("%u/%u", c.programBinds, c.redundantProgramBinds);
+                    ImGui::TableNextColumn(); ImGui::Text("%u/%u", c.textureBinds, c.redundantTextureBinds);
+                    ImGui::TableNextColumn(); ImGui::Text("%u/%u", c.framebufferBinds, c.redundantFramebufferBinds);
+                    ImGui::TableNextColumn(); ImGui::Text("%u/%u", c.vertexArrayBinds, c.redundantVertexArrayBinds);
+                    ImGui::TableNextColumn(); ImGui::Text("%u", c.uniformUploads);
+                };
+                for (const GLCallStats::PassCounters& p : glStats.passCounters())
+                    if (p.frame.drawCalls || p.frame.programBinds || p.frame.textureBinds || p.frame.framebufferBinds || p.frame.dispatches)
+                        row(p.name.c_str(), p.frame);
+                row("Total", glFrame);
+                ImGui::EndTable();
+            }
+            ImGui::Text("Binds: issued/redundant this frame; %u redundant in total", glFrame.redundantBinds());
+            if (useMultiDrawIndirect)
+                ImGui::Text("Render queue: %d items in %u indirect submissions (%u commands in all), %u drawn directly",
+                            (int)renderQueue.size(), renderQueue.indirectSubmissions, glFrame.indirectCommands,
+                            renderQueue.indirectFallbacks);
+            else
+                ImGui::Text("Render queue: %d items; elided %u program, %u texture, %u VAO binds", (int)renderQueue.size(),
+                            renderQueue.programBindsSkipped, renderQueue.textureBindsSkipped, renderQueue.vertexArrayBindsSkipped);
+            if (ImGui::Button("Dump JSON")) {
+                if (glStats.writeJSON("gl_stats.json")) cout << "Wrote gl_stats.json" << endl;
+            }
+            ImGui::End();
+        }
+
         // --- Minimap Display (Bottom-Left) - Only show when geographic location is selected ---
         if ((focusedPlanet == 3 && showEarthLocation) || (focusedPlanet == 6 && showSaturnLocation)) {
             ImGui::SetNextWindowPos(ImVec2(10, SCR_HEIGHT - MINIMAP_HEIGHT - 20));
@@ -2045,37 +6139,73 @@ int main() {
         }
 
         ImGui::Render();
+        frameSections.end();
+        gpuProfiler.begin("ImGui");
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        gpuProfiler.end();
 
 
         // --- Swap Buffers and Poll Events ---
+        frameSections.next("Swap");
         glfwSwapBuffers(window);
         glfwPollEvents();
+        frameSections.end();
+
+        if (traceFramesRemaining > 0 && --traceFramesRemaining == 0) cpuTrace.stopAndWrite("cpu_trace.json");
+    }
+
+    if (fixedFrameRun) {
+        if (exportOptions.enabled()) exporter.finish(); // Includes waiting for the writers
+        glFinish();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - loopStart).count();
+        if (exportOptions.enabled()) exporter.report(seconds);
+        cout << "Offscreen: " << headless.frames << " frames at " << SCR_WIDTH << "x" << SCR_HEIGHT << " in "
+             << fixed << setprecision(2) << seconds << " s (" << seconds * 1000.0 / headless.frames << " ms/frame)" << endl;
+        cout << "Render targets: " << (sceneTargetBytes + renderTargets.bytes()) / 1048576.0 << " MB ("
+             << renderTargets.count() << " pooled)" << endl;
+    }
+    bool benchWritten = true;
+    if (benchOptions.enabled()) {
+        benchWritten = bench.write(benchOptions.outputPath, SCR_WIDTH, SCR_HEIGHT, randomSeed);
+        if (benchWritten) cout << "Wrote " << benchOptions.outputPath << endl;
     }
 
+    if (!traceCapturePath.empty()) cpuTrace.stopAndWrite(traceCapturePath);
+    if (!profileCsvPath.empty() && gpuProfiler.writeCSV(profileCsvPath)) cout << "Wrote " << profileCsvPath << endl;
+    if (!glStatsPath.empty() && glStats.writeJSON(glStatsPath)) cout << "Wrote " << glStatsPath << endl;
+    gpuProfiler.shutdown();
+
     // --- Cleanup ---
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!headless.enabled) {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 
     glDeleteFramebuffers(1, &fboScene);
     glDeleteTextures(1, &texSceneColor);
     glDeleteTextures(1, &texBrightMap);
-    glDeleteRenderbuffers(1, &rboDepth);
-    glDeleteFramebuffers(2, fboBloom);
-    glDeleteTextures(2, texBloom);
-    glDeleteFramebuffers(1, &fboGodRays);
-    glDeleteTextures(1, &texGodRays);
-    glDeleteFramebuffers(1, &fboComposite);
-    glDeleteTextures(1, &texComposite);
-    glDeleteFramebuffers(1, &fboFinal);
-    glDeleteTextures(1, &texFinal);
+    glDeleteTextures(1, &texSceneDepth);
+    glDeleteFramebuffers(1, &fboMinimap);
+    glDeleteTextures(1, &texMinimap);
+    renderTargets.clear();
+    sunOcclusion.destroy();
+    indirectDraws.destroy();
 
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &quadVBO);
+    glDeleteBuffers(1, &frameUBO);
 
+    simulation.stop();
+    textures.shutdown();
+    glDeleteBuffers(1, &asteroidInstanceVBO);
+    glDeleteVertexArrays(1, &kuiperVAO);
+    glDeleteBuffers(1, &kuiperInstanceVBO);
     delete[] asteroidMatrices;
-    glfwTerminate();
-    return 0;
+#ifdef SOLAR_WITH_EGL
+    headlessContext.destroy();
+#endif
+    if (!headless.enabled) glfwTerminate();
+    return benchWritten ? 0 : 1;
 }
 //g++ src/solar1.cpp src/glad.c src/imgui.cpp src/imgui_draw.cpp src/imgui_widgets.cpp src/imgui_tables.cpp src/imgui_impl_glfw.cpp src/imgui_impl_opengl3.cpp -o Solar1.exe -Iinclude -Isrc -Llib -lglfw3 -lgdi32 -lopengl32
\ No newline at end of file